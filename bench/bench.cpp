@@ -0,0 +1,387 @@
+/*
+    Driver of the rxcpp-fsm benchmark suite.
+
+    usage: rxcpp_fsm_bench [--filter <substring>] [--min-time <ms>] [--repetitions <n>] [--baseline <file>] [--out <file>] [--no-counters]
+
+    Results are written as JSON. When a baseline file (i.e. the output of an earlier run) is specified, every
+    benchmark also reports the baseline time per event and the ratio to it.
+
+    On Linux, the cycles, instructions, L1 data cache read misses, last level cache misses and branch misses per
+    event are read by perf_event_open, of the thread running the benchmarks and the threads created while counting.
+    Counters that cannot be opened, e.g. in a virtual machine or with a restrictive kernel.perf_event_paranoid, are
+    left out of the results.
+*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<std::uint64_t> allocation_count(0);
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace bench {
+
+std::vector<benchmark>& benchmarks()
+{
+    static std::vector<benchmark> all;
+    return all;
+}
+
+std::uint64_t allocations()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+}
+
+namespace {
+
+struct options
+{
+    std::string filter;
+    std::string baseline;
+    std::string out;
+    std::chrono::milliseconds min_time{50};
+    int repetitions{5};
+    bool counters{true};
+};
+
+// the hardware performance counters that could be opened, all disabled unless counting
+class perf_counters
+{
+public:
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    explicit perf_counters(bool enabled)
+    {
+#if defined(__linux__)
+        if (!enabled) {
+            return;
+        }
+        auto cache = [](std::uint64_t level, std::uint64_t op, std::uint64_t result) {
+            return level | (op << 8) | (result << 16);
+        };
+        add("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        add("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        add("l1d_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        add("llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        add("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#else
+        (void)enabled;
+#endif
+    }
+
+    ~perf_counters()
+    {
+#if defined(__linux__)
+        for(const auto& c : counters)
+        {
+            ::close(c.fd);
+        }
+#endif
+    }
+
+    bool empty() const
+    {
+        return counters.empty();
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for(const auto& c : counters)
+        {
+            ::ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // the values counted since start, by name
+    std::vector<std::pair<std::string, double>> stop()
+    {
+        std::vector<std::pair<std::string, double>> values;
+#if defined(__linux__)
+        for(const auto& c : counters)
+        {
+            ::ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for(const auto& c : counters)
+        {
+            // value, time enabled and time running, the latter differ if the counters were multiplexed
+            std::uint64_t data[3] = {0, 0, 0};
+            if (::read(c.fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+                continue;
+            }
+            auto value = static_cast<double>(data[0]);
+            if (data[2] && data[2] < data[1]) {
+                value *= static_cast<double>(data[1]) / data[2];
+            }
+            values.emplace_back(c.name, value);
+        }
+#endif
+        return values;
+    }
+
+private:
+
+    struct counter
+    {
+        std::string name;
+        int fd;
+    };
+
+    std::vector<counter> counters;
+
+#if defined(__linux__)
+    void add(const char* name, std::uint32_t type, std::uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        auto fd = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd >= 0) {
+            counters.push_back(counter{name, fd});
+        }
+    }
+#endif
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+std::int64_t time_run(const bench::body& b, std::size_t events)
+{
+    auto start = clock_type::now();
+    b(events);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+}
+
+bench::result run(const bench::benchmark& bm, const options& opt, perf_counters& counters)
+{
+    auto b = bm.setup();
+    // warm up, and calibrate the number of events until a run takes at least the minimum time
+    std::size_t events(1);
+    auto min_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(opt.min_time).count();
+    for(;;)
+    {
+        auto ns = time_run(b, events);
+        if (ns >= min_ns || events >= (std::size_t(1) << 30)) {
+            break;
+        }
+        events *= ns * 10 < min_ns ? 10 : 2;
+    }
+    std::vector<double> ns_per_event;
+    std::vector<double> allocations_per_event;
+    std::map<std::string, std::vector<double>> counted_per_event;
+    for(int r = 0; r < opt.repetitions; ++r)
+    {
+        auto before = bench::allocations();
+        counters.start();
+        auto ns = time_run(b, events);
+        auto allocated = bench::allocations() - before;
+        auto counted = counters.stop();
+        ns_per_event.push_back(static_cast<double>(ns) / events);
+        allocations_per_event.push_back(static_cast<double>(allocated) / events);
+        for(const auto& c : counted)
+        {
+            counted_per_event[c.first].push_back(c.second / events);
+        }
+    }
+    auto median = [](std::vector<double>& v) {
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    };
+    bench::result result{bm.name, events, median(ns_per_event), median(allocations_per_event), {}};
+    for(auto& c : counted_per_event)
+    {
+        result.counters_per_event.emplace_back(c.first, median(c.second));
+    }
+    return result;
+}
+
+// reads the time per event of every benchmark of an earlier run, i.e. the output of this program
+std::map<std::string, double> read_baseline(const std::string& file)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "cannot read baseline '" << file << "'" << std::endl;
+        return baseline;
+    }
+    std::stringstream s;
+    s << in.rdbuf();
+    auto text = s.str();
+    const std::string name_key("\"name\": \"");
+    const std::string ns_key("\"ns_per_event\": ");
+    std::size_t pos(0);
+    while ((pos = text.find(name_key, pos)) != std::string::npos)
+    {
+        pos += name_key.size();
+        auto end = text.find('"', pos);
+        auto ns = text.find(ns_key, end);
+        if (end == std::string::npos || ns == std::string::npos) {
+            break;
+        }
+        baseline[text.substr(pos, end - pos)] = std::strtod(text.c_str() + ns + ns_key.size(), nullptr);
+        pos = ns;
+    }
+    return baseline;
+}
+
+void write_json(std::ostream& out, const std::vector<bench::result>& results, const std::map<std::string, double>& baseline)
+{
+    out << "{\n  \"benchmarks\": [";
+    for(std::size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"events\": " << r.events
+            << ", \"ns_per_event\": " << r.ns_per_event << ", \"allocations_per_event\": " << r.allocations_per_event;
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            out << ", \"baseline_ns_per_event\": " << it->second << ", \"ratio\": " << r.ns_per_event / it->second;
+        }
+        if (!r.counters_per_event.empty()) {
+            out << ", \"counters_per_event\": {";
+            for(std::size_t c = 0; c < r.counters_per_event.size(); ++c)
+            {
+                out << (c ? ", \"" : "\"") << r.counters_per_event[c].first << "\": " << r.counters_per_event[c].second;
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        std::string value(i + 1 < argc ? argv[i + 1] : "");
+        if (arg == "--filter") {
+            opt.filter = value;
+        } else if (arg == "--baseline") {
+            opt.baseline = value;
+        } else if (arg == "--out") {
+            opt.out = value;
+        } else if (arg == "--min-time") {
+            opt.min_time = std::chrono::milliseconds(std::atoi(value.c_str()));
+        } else if (arg == "--repetitions") {
+            opt.repetitions = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--no-counters") {
+            opt.counters = false;
+            continue;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--filter <substring>] [--min-time <ms>] [--repetitions <n>] [--baseline <file>] [--out <file>] [--no-counters]" << std::endl;
+            return 1;
+        }
+        ++i;
+    }
+    perf_counters counters(opt.counters);
+    if (opt.counters && counters.empty()) {
+        std::cerr << "hardware performance counters not available" << std::endl;
+    }
+    std::map<std::string, double> baseline;
+    if (!opt.baseline.empty()) {
+        baseline = read_baseline(opt.baseline);
+    }
+    std::vector<bench::result> results;
+    for(const auto& bm : bench::benchmarks())
+    {
+        if (bm.name.find(opt.filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(run(bm, opt, counters));
+        const auto& r = results.back();
+        std::cerr << r.name << ": " << r.ns_per_event << " ns/event, " << r.allocations_per_event << " allocations/event";
+        for(const auto& c : r.counters_per_event)
+        {
+            std::cerr << ", " << c.second << " " << c.first << "/event";
+        }
+        std::cerr << std::endl;
+    }
+    if (opt.out.empty()) {
+        write_json(std::cout, results, baseline);
+    } else {
+        std::ofstream out(opt.out);
+        write_json(out, results, baseline);
+    }
+    return 0;
+}
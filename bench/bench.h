@@ -0,0 +1,86 @@
+/*
+    Minimal benchmark harness of the rxcpp-fsm benchmark suite.
+
+    A benchmark is registered with BENCHMARK(name) and sets up a fixture, returning the body to measure. The body
+    is called with a number of events to process, the harness calibrates that number until a run takes long enough,
+    and reports the median time, the number of heap allocations and, where available, the hardware performance
+    counters per event.
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_BENCH_H)
+#define RX_FSM_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// processes the specified number of events
+typedef std::function<void(std::size_t)> body;
+
+// sets up a fixture, and returns the body processing events with it
+typedef std::function<body()> setup;
+
+struct benchmark
+{
+    std::string name;
+    bench::setup setup;
+};
+
+struct result
+{
+    std::string name;
+    std::size_t events;
+    double ns_per_event;
+    double allocations_per_event;
+    // hardware performance counters per event by name, empty if not available
+    std::vector<std::pair<std::string, double>> counters_per_event;
+};
+
+std::vector<benchmark>& benchmarks();
+
+// number of heap allocations made by the process so far
+std::uint64_t allocations();
+
+struct registrar
+{
+    registrar(std::string name, bench::setup s)
+    {
+        benchmarks().push_back(benchmark{std::move(name), std::move(s)});
+    }
+};
+
+// prevents the compiler from optimizing away a computed value
+template<class T>
+void keep(const T& value)
+{
+#if defined(_MSC_VER)
+    static const void* volatile sink;
+    sink = &value;
+#else
+    asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+}
+
+#define BENCH_CAT_(a, b) a##b
+#define BENCH_CAT(a, b) BENCH_CAT_(a, b)
+
+/*  Registers a benchmark, followed by the body of the setup function, e.g.
+
+    BENCHMARK("flat/ping_pong") {
+        auto fixture = ...;
+        return [fixture](std::size_t n) { ... };
+    }
+*/
+#define BENCHMARK(name) \
+    static bench::body BENCH_CAT(bench_setup_, __LINE__)(); \
+    static bench::registrar BENCH_CAT(bench_registrar_, __LINE__)(name, &BENCH_CAT(bench_setup_, __LINE__)); \
+    static bench::body BENCH_CAT(bench_setup_, __LINE__)()
+
+#endif
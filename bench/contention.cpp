@@ -0,0 +1,81 @@
+/*
+    Contention benchmark, many producer threads firing events into one state machine.
+
+    Compares a state machine assembled on serialize_event_loop() with one assembled on flat_combining.
+
+    usage: rxcpp_fsm_contention [producers] [events per producer]
+*/
+
+#include "rxcpp/rx.hpp"
+#include "rxcpp/rx-fsm.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+template<class Coordination>
+void run(const std::string& name, Coordination cn, int producers, int events)
+{
+    auto sm = rxcpp::fsm::make_state_machine(name);
+    rxcpp::subjects::subject<int> subject;
+    auto trigger = subject.get_observable();
+    std::atomic<long> processed(0);
+    std::atomic<bool> started(false);
+    auto initial = rxcpp::fsm::make_initial_pseudostate("initial");
+    auto s1 = rxcpp::fsm::make_state("s1");
+    initial.with_transition("initial_2_s1", s1);
+    s1.with_on_entry([&started]() {
+        started = true;
+    }).with_transition("count", trigger, [&processed](int) {
+        processed.fetch_add(1, std::memory_order_relaxed);
+    });
+    sm.with_state(initial, s1);
+    auto lifetime = sm.start(cn);
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    auto subscriber = subject.get_subscriber();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&subscriber, events]() {
+            for(int i = 0; i < events; ++i)
+            {
+                subscriber.on_next(i);
+            }
+        });
+    }
+    for(auto& t : threads)
+    {
+        t.join();
+    }
+    long total = static_cast<long>(producers) * events;
+    while (processed.load() < total)
+    {
+        std::this_thread::yield();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    lifetime.unsubscribe();
+    std::cout << name << ": " << total << " events in " << elapsed / 1000000.0 << " ms, "
+              << (total * 1000000000.0 / elapsed) << " events/s" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int producers = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+    int events = argc > 2 ? std::atoi(argv[2]) : 100000;
+    if (producers < 1) {
+        producers = 1;
+    }
+    std::cout << producers << " producers, " << events << " events each" << std::endl;
+    run("serialize_event_loop", rxcpp::serialize_event_loop(), producers, events);
+    run("flat_combining", rxcpp::fsm::make_flat_combining(), producers, events);
+    return 0;
+}
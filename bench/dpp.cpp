@@ -0,0 +1,340 @@
+/*
+    Dining philosophers benchmark, a scalable and silent build of examples/dpp.cpp.
+
+    Every philosopher is a state machine thinking and eating on timeouts, the table is a state machine handing out
+    forks on the requests of the philosophers, and triggering the philosophers to eat. After the run all machines are
+    terminated, the workers they run on are drained, and the throughput, the fairness of the meals and the latency of the eat trigger are reported.
+
+    usage: rxcpp_fsm_dpp [--philosophers <n>] [--think <ms>] [--eat <ms>] [--seconds <s>]
+                         [--coordination event_loop|work_stealing|sharded]
+*/
+
+#include "rxcpp/rx.hpp"
+#include "rxcpp/rx-fsm.hpp"
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fsm = rxcpp::fsm;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// one latency histogram per thread, added up when reporting
+struct latencies
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<bench::histogram>> histograms;
+
+    bench::histogram& local()
+    {
+        thread_local bench::histogram* h(nullptr);
+        if (!h) {
+            std::lock_guard<std::mutex> guard(lock);
+            histograms.emplace_back(new bench::histogram());
+            h = histograms.back().get();
+        }
+        return *h;
+    }
+
+    void add_to(bench::histogram& total)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(const auto& h : histograms)
+        {
+            total.add(*h);
+        }
+    }
+};
+
+latencies eat_latencies;
+
+class table;
+
+class philosopher final
+{
+public:
+
+    philosopher(std::size_t index, int think_ms, int eat_ms, ::table& t);
+
+    void eat()
+    {
+        eat_requested.store(now_ns(), std::memory_order_relaxed);
+        eat_source.on_next(1);
+    }
+
+    bool is_hungry() const
+    {
+        return hungry;
+    }
+
+    bool fork;
+    std::atomic<int> ate;
+    fsm::state_machine sm;
+
+private:
+
+    std::size_t index;
+    fsm::event_source<int> eat_source;
+    ::table& table;
+    std::atomic<bool> hungry;
+    std::atomic<std::int64_t> eat_requested;
+};
+
+class table final
+{
+public:
+
+    table()
+        : sm(fsm::make_state_machine("table"))
+        , hungry_subscriber(hungry_subject.get_subscriber())
+        , done_subscriber(done_subject.get_subscriber())
+    {
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto serving = fsm::make_state("serving");
+        initial.with_transition("initial", serving);
+        serving.with_transition("internal_hungry", hungry_subject.get_observable(), [this](std::size_t i) {
+            do_hungry(i);
+        }).with_transition("internal_done", done_subject.get_observable(), [this](std::size_t i) {
+            do_done(i);
+        });
+        sm.with_state(initial, serving);
+    }
+
+    void hungry(std::size_t i)
+    {
+        hungry_subscriber.on_next(i);
+    }
+
+    void done(std::size_t i)
+    {
+        done_subscriber.on_next(i);
+    }
+
+    fsm::state_machine sm;
+    std::vector<std::unique_ptr<philosopher>> philosophers;
+
+private:
+
+    // the table machine is serialized, i.e. the forks need no further synchronization
+    std::size_t left(std::size_t i) const
+    {
+        return i == 0 ? philosophers.size() - 1 : i - 1;
+    }
+
+    std::size_t right(std::size_t i) const
+    {
+        return i + 1 == philosophers.size() ? 0 : i + 1;
+    }
+
+    bool try_serve(std::size_t i)
+    {
+        auto& p = *philosophers[i];
+        auto& left_fork = philosophers[left(i)]->fork;
+        if (p.is_hungry() && p.fork && left_fork) {
+            p.fork = left_fork = false;
+            p.eat();
+            return true;
+        }
+        return false;
+    }
+
+    void do_hungry(std::size_t i)
+    {
+        try_serve(i);
+    }
+
+    void do_done(std::size_t i)
+    {
+        philosophers[i]->fork = philosophers[left(i)]->fork = true;
+        try_serve(right(i));
+        try_serve(left(i));
+    }
+
+    rxcpp::subjects::subject<std::size_t> hungry_subject, done_subject;
+    rxcpp::subscriber<std::size_t> hungry_subscriber, done_subscriber;
+};
+
+philosopher::philosopher(std::size_t i, int think_ms, int eat_ms, ::table& t)
+    : fork(true)
+    , ate(0)
+    , sm(fsm::make_state_machine("philosopher" + std::to_string(i)))
+    , index(i)
+    , table(t)
+    , hungry(false)
+    , eat_requested(0)
+{
+    auto initial = fsm::make_initial_pseudostate("initial");
+    auto thinking = fsm::make_state("thinking");
+    auto hungry = fsm::make_state("hungry");
+    auto eating = fsm::make_state("eating");
+    initial.with_transition("initial", thinking);
+    thinking.with_transition("thinking_to_hungry", hungry, std::chrono::milliseconds(think_ms));
+    hungry.with_on_entry([this]() {
+        this->hungry = true;
+        table.hungry(index);
+    }).with_on_exit([this]() {
+        this->hungry = false;
+    }).with_transition("hungry_to_eating", eating, eat_source.get_observable());
+    eating.with_on_entry([this]() {
+        eat_latencies.local().record(static_cast<std::uint64_t>(now_ns() - eat_requested.load(std::memory_order_relaxed)));
+        ++ate;
+    }).with_on_exit([this]() {
+        table.done(index);
+    }).with_transition("eating_to_thinking", thinking, std::chrono::milliseconds(eat_ms));
+    sm.with_state(initial, thinking, hungry, eating);
+}
+
+struct options
+{
+    std::size_t philosophers{1000};
+    int think_ms{10};
+    int eat_ms{10};
+    int seconds{10};
+    std::string coordination{"event_loop"};
+};
+
+// terminate() does not wait for the steps running on other threads, i.e. every worker a machine ran on has to pass a
+// barrier before the table and the philosophers may be destroyed
+void drain(const std::vector<rxcpp::schedulers::worker>& workers)
+{
+    std::mutex lock;
+    std::condition_variable passed;
+    auto pending = workers.size();
+    for(const auto& w : workers)
+    {
+        w.schedule([&](const rxcpp::schedulers::schedulable&) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (--pending == 0) {
+                passed.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    passed.wait(guard, [&pending]() {
+        return pending == 0;
+    });
+}
+
+// start returns the worker the machine runs on
+template<class Start>
+void run(const options& opt, Start start)
+{
+    ::table t;
+    for(std::size_t i = 0; i < opt.philosophers; ++i)
+    {
+        t.philosophers.emplace_back(new philosopher(i, opt.think_ms, opt.eat_ms, t));
+    }
+    auto cpu_start = std::clock();
+    auto wall_start = clock_type::now();
+    std::vector<rxcpp::schedulers::worker> workers;
+    workers.push_back(start(t.sm));
+    for(auto& p : t.philosophers)
+    {
+        workers.push_back(start(p->sm));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    for(auto& p : t.philosophers)
+    {
+        p->sm.terminate();
+    }
+    t.sm.terminate();
+    drain(workers);
+    auto wall = std::chrono::duration<double>(clock_type::now() - wall_start).count();
+    auto cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    std::vector<int> meals;
+    for(auto& p : t.philosophers)
+    {
+        meals.push_back(p->ate.load());
+    }
+    std::sort(meals.begin(), meals.end());
+    double total(0), squares(0);
+    for(auto m : meals)
+    {
+        total += m;
+        squares += static_cast<double>(m) * m;
+    }
+    auto n = static_cast<double>(meals.size());
+    auto mean = total / n;
+    auto deviation = std::sqrt(std::max(0.0, squares / n - mean * mean));
+    // Jain's fairness index, 1 if all philosophers ate equally often
+    auto fairness = squares > 0 ? total * total / (n * squares) : 1.0;
+    bench::histogram latency;
+    eat_latencies.add_to(latency);
+
+    std::cout << "{\"coordination\": \"" << opt.coordination << "\", \"philosophers\": " << opt.philosophers
+              << ", \"think_ms\": " << opt.think_ms << ", \"eat_ms\": " << opt.eat_ms << ", \"seconds\": " << wall
+              << ",\n \"meals\": " << total << ", \"meals_per_second\": " << total / wall
+              << ",\n \"ate\": {\"min\": " << meals.front() << ", \"p50\": " << meals[meals.size() / 2]
+              << ", \"max\": " << meals.back() << ", \"mean\": " << mean << ", \"stddev\": " << deviation
+              << ", \"fairness\": " << fairness << "}"
+              << ",\n \"eat_latency_ns\": {\"p50\": " << latency.percentile(50) << ", \"p99\": " << latency.percentile(99)
+              << ", \"p999\": " << latency.percentile(99.9) << ", \"max\": " << latency.max() << "}"
+              << ",\n \"cpu_us_per_meal\": " << (total > 0 ? cpu * 1e6 / total : 0.0) << "}" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg(argv[i]);
+        std::string value(argv[i + 1]);
+        if (arg == "--philosophers") {
+            opt.philosophers = static_cast<std::size_t>(std::max(2, std::atoi(value.c_str())));
+        } else if (arg == "--think") {
+            opt.think_ms = std::atoi(value.c_str());
+        } else if (arg == "--eat") {
+            opt.eat_ms = std::atoi(value.c_str());
+        } else if (arg == "--seconds") {
+            opt.seconds = std::atoi(value.c_str());
+        } else if (arg == "--coordination") {
+            opt.coordination = value;
+        }
+    }
+    if (opt.coordination == "event_loop") {
+        auto loop = rxcpp::schedulers::make_event_loop();
+        run(opt, [&loop](fsm::state_machine& sm) {
+            auto w = loop.create_worker();
+            sm.start(rxcpp::serialize_same_worker(w));
+            return w;
+        });
+    } else if (opt.coordination == "work_stealing") {
+        auto ws = fsm::make_work_stealing();
+        run(opt, [&ws](fsm::state_machine& sm) {
+            auto cn = ws.create_coordination();
+            sm.start(cn);
+            return cn.create_coordinator().get_worker();
+        });
+    } else if (opt.coordination == "sharded") {
+        auto runtime = fsm::make_sharded_runtime();
+        run(opt, [&runtime](fsm::state_machine& sm) {
+            auto cn = runtime.shard_for(sm.name());
+            sm.start(cn);
+            return cn.create_coordinator().get_worker();
+        });
+    } else {
+        std::cerr << "unknown coordination '" << opt.coordination << "'" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+    Log linear histogram of the rxcpp-fsm benchmark suite, e.g. of latencies in nanoseconds.
+
+    Values are bucketed by their power of two, and every power of two is split into 32 linear sub buckets, i.e. a
+    recorded value is reported with a relative error below 3.2% over the whole 64 bit range, in fixed memory.
+    Recording is wait free and intended for one writer per histogram, histograms of several threads are added
+    up when reporting.
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_BENCH_HISTOGRAM_H)
+#define RX_FSM_BENCH_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace bench {
+
+class histogram
+{
+public:
+
+    static const unsigned sub_bucket_bits = 5;
+    static const std::uint64_t sub_buckets = std::uint64_t(1) << sub_bucket_bits;
+    static const std::size_t buckets = static_cast<std::size_t>(sub_buckets + (64 - sub_bucket_bits) * sub_buckets);
+
+    histogram()
+        : counts(buckets)
+        , max_(0)
+    {
+    }
+
+    histogram(const histogram&) = delete;
+    histogram& operator=(const histogram&) = delete;
+
+    // records a value, must not be called concurrently for the same histogram
+    void record(std::uint64_t value)
+    {
+        auto& c = counts[index(value)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // adds the values recorded by another histogram, which may still be recording
+    void add(const histogram& other)
+    {
+        for(std::size_t i = 0; i < buckets; ++i)
+        {
+            auto& c = counts[i];
+            c.store(c.load(std::memory_order_relaxed) + other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        auto m = other.max_.load(std::memory_order_relaxed);
+        if (m > max_.load(std::memory_order_relaxed)) {
+            max_.store(m, std::memory_order_relaxed);
+        }
+    }
+
+    std::uint64_t count() const
+    {
+        std::uint64_t n(0);
+        for(const auto& c : counts)
+        {
+            n += c.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    std::uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // the highest value equivalent to the value at the specified percentile, i.e. within 0..100
+    std::uint64_t percentile(double p) const
+    {
+        auto n = count();
+        if (n == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(p / 100.0 * n + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        std::uint64_t seen(0);
+        for(std::size_t i = 0; i < buckets; ++i)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                auto highest = upper_bound(i);
+                return highest < max() ? highest : max();
+            }
+        }
+        return max();
+    }
+
+    double mean() const
+    {
+        double sum(0);
+        std::uint64_t n(0);
+        for(std::size_t i = 0; i < buckets; ++i)
+        {
+            auto c = counts[i].load(std::memory_order_relaxed);
+            sum += c * (static_cast<double>(lower_bound(i)) + static_cast<double>(upper_bound(i))) / 2;
+            n += c;
+        }
+        return n ? sum / n : 0;
+    }
+
+private:
+
+    static unsigned magnitude(std::uint64_t value)
+    {
+        unsigned m(0);
+        while (value >>= 1)
+        {
+            ++m;
+        }
+        return m;
+    }
+
+    static std::size_t index(std::uint64_t value)
+    {
+        if (value < sub_buckets) {
+            return static_cast<std::size_t>(value);
+        }
+        auto m = magnitude(value);
+        auto offset = (value >> (m - sub_bucket_bits)) - sub_buckets;
+        return static_cast<std::size_t>(sub_buckets + (m - sub_bucket_bits) * sub_buckets + offset);
+    }
+
+    static std::uint64_t lower_bound(std::size_t i)
+    {
+        if (i < sub_buckets) {
+            return i;
+        }
+        auto shift = (i - sub_buckets) / sub_buckets;
+        auto offset = (i - sub_buckets) % sub_buckets;
+        return (sub_buckets + offset) << shift;
+    }
+
+    static std::uint64_t upper_bound(std::size_t i)
+    {
+        if (i < sub_buckets) {
+            return i;
+        }
+        auto shift = (i - sub_buckets) / sub_buckets;
+        return lower_bound(i) + ((std::uint64_t(1) << shift) - 1);
+    }
+
+    std::vector<std::atomic<std::uint64_t>> counts;
+    std::atomic<std::uint64_t> max_;
+};
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+    Ping pong latency benchmark, two state machines on different coordinations triggering each other through subjects.
+
+    Every round the ball is sent to the pong machine, which returns it to the ping machine. The one way latency
+    (from on_next of the sender until the action of the receiver executes) and the round trip latency are recorded in
+    histograms, and reported per coordination as JSON, one object per line.
+
+    usage: rxcpp_fsm_ping_pong [--rounds <n>] [--warmup <n>] [--filter <substring>]
+*/
+
+#include "rxcpp/rx.hpp"
+#include "rxcpp/rx-fsm.hpp"
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace fsm = rxcpp::fsm;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+struct ball
+{
+    // time the ball was sent by the last machine, and time the round started
+    std::int64_t sent;
+    std::int64_t origin;
+    int round;
+};
+
+// what the actions record into, shared with them since a ball may still be in flight when a run times out
+struct court
+{
+    // one writer per histogram, i.e. the machine recording into it
+    bench::histogram ping_one_way, pong_one_way, round_trip;
+    std::atomic<int> started{0};
+    std::atomic<int> completed{-1};
+};
+
+struct options
+{
+    int rounds{100000};
+    int warmup{1000};
+    std::string filter;
+};
+
+void print(std::ostream& out, const char* name, const bench::histogram& h)
+{
+    out << "\"" << name << "\": {\"count\": " << h.count() << ", \"p50\": " << h.percentile(50) << ", \"p99\": " << h.percentile(99)
+        << ", \"p999\": " << h.percentile(99.9) << ", \"max\": " << h.max() << "}";
+}
+
+template<class PingCoordination, class PongCoordination>
+void run(const std::string& name, const options& opt, PingCoordination ping_cn, PongCoordination pong_cn)
+{
+    if (name.find(opt.filter) == std::string::npos) {
+        return;
+    }
+    auto c = std::make_shared<court>();
+    rxcpp::subjects::subject<ball> ping, pong;
+    auto ping_subscriber = ping.get_subscriber();
+    auto pong_subscriber = pong.get_subscriber();
+    auto make = [c](fsm::state_machine& sm, rxcpp::observable<ball> trigger, std::function<void(const ball&)> action) {
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto playing = fsm::make_state("playing");
+        initial.with_transition("initial_2_playing", playing);
+        playing.with_on_entry([c]() {
+            ++c->started;
+        }).with_transition("receive", trigger, action);
+        sm.with_state(initial, playing);
+    };
+    auto ping_sm = fsm::make_state_machine("ping");
+    auto pong_sm = fsm::make_state_machine("pong");
+    auto warmup = opt.warmup;
+    make(ping_sm, pong.get_observable(), [c, warmup](const ball& b) {
+        auto now = now_ns();
+        if (b.round >= warmup) {
+            c->pong_one_way.record(static_cast<std::uint64_t>(now - b.sent));
+            c->round_trip.record(static_cast<std::uint64_t>(now - b.origin));
+        }
+        c->completed.store(b.round, std::memory_order_release);
+    });
+    make(pong_sm, ping.get_observable(), [c, pong_subscriber, warmup](const ball& b) {
+        auto now = now_ns();
+        if (b.round >= warmup) {
+            c->ping_one_way.record(static_cast<std::uint64_t>(now - b.sent));
+        }
+        pong_subscriber.on_next(ball{now_ns(), b.origin, b.round});
+    });
+    ping_sm.start(std::move(ping_cn));
+    pong_sm.start(std::move(pong_cn));
+    while (c->started.load() < 2)
+    {
+        std::this_thread::yield();
+    }
+    // every round is served from here, i.e. synchronous coordinations do not recurse once per round
+    bool done(true);
+    for(int r = 0; r < opt.warmup + opt.rounds && done; ++r)
+    {
+        auto t = now_ns();
+        ping_subscriber.on_next(ball{t, t, r});
+        auto deadline = clock_type::now() + std::chrono::seconds(10);
+        while (c->completed.load(std::memory_order_acquire) < r)
+        {
+            if (clock_type::now() > deadline) {
+                done = false;
+                break;
+            }
+        }
+    }
+    ping_sm.terminate();
+    pong_sm.terminate();
+    std::cout << "{\"coordination\": \"" << name << "\", \"rounds\": " << c->round_trip.count() << ", \"completed\": " << (done ? "true" : "false") << ", ";
+    print(std::cout, "ping_one_way_ns", c->ping_one_way);
+    std::cout << ", ";
+    print(std::cout, "pong_one_way_ns", c->pong_one_way);
+    std::cout << ", ";
+    print(std::cout, "round_trip_ns", c->round_trip);
+    std::cout << "}" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg(argv[i]);
+        std::string value(argv[i + 1]);
+        if (arg == "--rounds") {
+            opt.rounds = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--warmup") {
+            opt.warmup = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--filter") {
+            opt.filter = value;
+        }
+    }
+    run("identity_current_thread", opt, rxcpp::identity_current_thread(), rxcpp::identity_current_thread());
+    run("serialize_event_loop", opt, rxcpp::serialize_event_loop(), rxcpp::serialize_event_loop());
+    run("serialize_new_thread", opt, rxcpp::serialize_new_thread(), rxcpp::serialize_new_thread());
+    run("flat_combining", opt, fsm::make_flat_combining(), fsm::make_flat_combining());
+    auto ws = fsm::make_work_stealing(2);
+    run("work_stealing", opt, ws.create_coordination(), ws.create_coordination());
+    auto runtime = fsm::make_sharded_runtime(2, false);
+    run("sharded_runtime", opt, runtime.get_shard(0), runtime.get_shard(1));
+    run("busy_poll", opt, fsm::make_busy_poll(), fsm::make_busy_poll());
+    return 0;
+}
@@ -0,0 +1,357 @@
+/*
+    Microbenchmarks of the state machine runtime, i.e. the cost of dispatching one event through machines of
+    different shapes, compared with a hand written switch based state machine.
+
+    All machines are started on identity_immediate(), i.e. an event is completely processed when fire returns.
+*/
+
+#include "rxcpp/rx.hpp"
+#include "rxcpp/rx-test.hpp"
+#include "rxcpp/rx-fsm.hpp"
+
+#include "bench.h"
+
+namespace fsm = rxcpp::fsm;
+namespace rxsc = rxcpp::schedulers;
+
+namespace {
+
+struct fixture
+{
+    fsm::state_machine sm;
+    fsm::event_id event;
+    long counter;
+
+    explicit fixture(const std::string& e)
+        : sm(fsm::make_state_machine("bench"))
+        , event(e)
+        , counter(0)
+    {
+    }
+
+    void start()
+    {
+        sm.start(rxcpp::identity_immediate());
+    }
+
+    bench::body fire()
+    {
+        auto self = this;
+        return [self](std::size_t n) {
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                self->sm.fire(self->event);
+            }
+        };
+    }
+
+    ~fixture()
+    {
+        sm.terminate();
+    }
+};
+
+// keeps the fixture alive as long as the body, actions of the machine refer to the fixture by raw pointer to avoid a cycle
+bench::body own(std::shared_ptr<fixture> f)
+{
+    auto b = f->fire();
+    return [f, b](std::size_t n) {
+        b(n);
+    };
+}
+
+std::string suffix(const std::string& name, std::size_t value)
+{
+    return name + ":" + std::to_string(value);
+}
+
+// a chain of nested composite states, returning the outermost one
+fsm::state make_nested(fixture& f, const std::string& prefix, std::size_t depth)
+{
+    auto outer = fsm::make_state(suffix(prefix, 0));
+    outer.with_on_entry([&f]() {++f.counter;});
+    auto parent = outer;
+    for(std::size_t d = 1; d < depth; ++d)
+    {
+        auto child = fsm::make_state(suffix(prefix, d));
+        child.with_on_entry([&f]() {++f.counter;});
+        auto initial = fsm::make_initial_pseudostate(suffix(prefix + "_initial", d));
+        initial.with_transition(suffix(prefix + "_initial_2_" + prefix, d), child);
+        parent.with_sub_state(initial, child);
+        parent = child;
+    }
+    return outer;
+}
+
+BENCHMARK("baseline/switch") {
+    // the same ping pong as flat/ping_pong, written by hand
+    enum class state_id { s1, s2 };
+    struct machine
+    {
+        state_id current;
+        long counter;
+
+        void dispatch(int event)
+        {
+            switch (current)
+            {
+            case state_id::s1:
+                if (event == 0) {
+                    current = state_id::s2;
+                    ++counter;
+                }
+                break;
+            case state_id::s2:
+                if (event == 0) {
+                    current = state_id::s1;
+                    ++counter;
+                }
+                break;
+            }
+        }
+    };
+    auto m = std::make_shared<machine>();
+    m->current = state_id::s1;
+    m->counter = 0;
+    return [m](std::size_t n) {
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            m->dispatch(0);
+            bench::keep(m->counter);
+        }
+    };
+}
+
+bench::body ping_pong(std::shared_ptr<fsm::tracer> t, bool metrics = false)
+{
+    auto f = std::make_shared<fixture>("TOGGLE");
+    if (t) {
+        f->sm.with_tracer(t);
+    }
+    if (metrics) {
+        f->sm.with_metrics();
+    }
+    auto initial = fsm::make_initial_pseudostate("initial");
+    auto s1 = fsm::make_state("s1");
+    auto s2 = fsm::make_state("s2");
+    initial.with_transition("initial_2_s1", s1);
+    auto p = f.get();
+    s1.with_transition("s1_2_s2", s2, f->sm.on_event("TOGGLE"), [p](const fsm::event_id&) {++p->counter;});
+    s2.with_transition("s2_2_s1", s1, f->sm.on_event("TOGGLE"), [p](const fsm::event_id&) {++p->counter;});
+    f->sm.with_state(initial, s1, s2);
+    f->start();
+    return own(f);
+}
+
+BENCHMARK("flat/ping_pong") {
+    return ping_pong(nullptr);
+}
+
+#if defined(RXCPP_FSM_TRACING)
+BENCHMARK("tracing/ping_pong") {
+    // flat/ping_pong with a tracer ignoring all trace points, i.e. the cost of the trace points themselves
+    return ping_pong(std::make_shared<fsm::tracer>());
+}
+const bool chrome_trace_registered = []() {
+    for(std::size_t sample_every : {1, 64})
+    {
+        // flat/ping_pong exporting a Chrome trace to a stream discarding it
+        bench::registrar(suffix("tracing/chrome_trace/sample", sample_every), [sample_every]() {
+            auto trace = fsm::make_chrome_trace(std::make_shared<std::ostream>(nullptr), sample_every);
+            auto b = ping_pong(trace.get_tracer());
+            return [trace, b](std::size_t n) {
+                b(n);
+            };
+        });
+    }
+    return true;
+}();
+
+BENCHMARK("tracing/metrics/ping_pong") {
+    // flat/ping_pong collecting metrics
+    return ping_pong(nullptr, true);
+}
+#else
+BENCHMARK("tracing/compiled_out/ping_pong") {
+    // flat/ping_pong with a tracer attached but the trace points compiled out, i.e. the same cost as flat/ping_pong
+    return ping_pong(std::make_shared<fsm::tracer>());
+}
+#endif
+
+const bool hierarchy_registered = []() {
+    for(std::size_t depth : {1, 2, 4, 8, 16, 32})
+    {
+        bench::registrar(suffix("hierarchy/depth", depth), [depth]() {
+            auto f = std::make_shared<fixture>("TOGGLE");
+            auto initial = fsm::make_initial_pseudostate("initial");
+            auto a = make_nested(*f, "a", depth);
+            auto b = make_nested(*f, "b", depth);
+            initial.with_transition("initial_2_a", a);
+            a.with_transition("a_2_b", b, f->sm.on_event("TOGGLE"));
+            b.with_transition("b_2_a", a, f->sm.on_event("TOGGLE"));
+            f->sm.with_state(initial, a, b);
+            f->start();
+            return own(f);
+        });
+    }
+    return true;
+}();
+
+const bool orthogonal_registered = []() {
+    for(std::size_t width : {2, 8, 32})
+    {
+        bench::registrar(suffix("orthogonal/regions", width), [width]() {
+            auto f = std::make_shared<fixture>("TOGGLE");
+            auto initial = fsm::make_initial_pseudostate("initial");
+            auto idle = fsm::make_state("idle");
+            auto busy = fsm::make_state("busy");
+            initial.with_transition("initial_2_idle", idle);
+            idle.with_transition("idle_2_busy", busy, f->sm.on_event("TOGGLE"));
+            busy.with_transition("busy_2_idle", idle, f->sm.on_event("TOGGLE"));
+            for(std::size_t i = 0; i < width; ++i)
+            {
+                auto r = fsm::make_region(suffix("r", i));
+                auto r_initial = fsm::make_initial_pseudostate(suffix("r_initial", i));
+                auto r_s1 = fsm::make_state(suffix("r_s1", i));
+                auto p = f.get();
+                r_s1.with_on_entry([p]() {++p->counter;});
+                r_initial.with_transition(suffix("r_initial_2_r_s1", i), r_s1);
+                r.with_sub_state(r_initial, r_s1);
+                busy.with_region(r);
+            }
+            f->sm.with_state(initial, idle, busy);
+            f->start();
+            return own(f);
+        });
+    }
+    return true;
+}();
+
+template<class MakeHistory>
+bench::body history(MakeHistory make_history)
+{
+    // leaves a composite state of depth 4 and re-enters it through its history on every other event
+    auto f = std::make_shared<fixture>("TOGGLE");
+    auto initial = fsm::make_initial_pseudostate("initial");
+    auto s1 = make_nested(*f, "s1", 4);
+    auto s2 = fsm::make_state("s2");
+    auto h = make_history("history");
+    s1.with_sub_state(h);
+    initial.with_transition("initial_2_s1", s1);
+    s1.with_transition("s1_2_s2", s2, f->sm.on_event("TOGGLE"));
+    s2.with_transition("s2_2_history", h, f->sm.on_event("TOGGLE"));
+    f->sm.with_state(initial, s1, s2);
+    f->start();
+    return own(f);
+}
+
+BENCHMARK("history/shallow") {
+    return history(&fsm::make_shallow_history_pseudostate);
+}
+
+BENCHMARK("history/deep") {
+    return history(&fsm::make_deep_history_pseudostate);
+}
+
+template<class MakePseudostate>
+bench::body chain(MakePseudostate make_pseudostate, std::size_t length)
+{
+    // every other event passes a chain of guarded pseudostates
+    auto f = std::make_shared<fixture>("GO");
+    auto initial = fsm::make_initial_pseudostate("initial");
+    auto s1 = fsm::make_state("s1");
+    auto s2 = fsm::make_state("s2");
+    initial.with_transition("initial_2_s1", s1);
+    f->sm.with_state(initial, s1, s2);
+    std::vector<fsm::pseudostate> chain;
+    for(std::size_t i = 0; i < length; ++i)
+    {
+        chain.push_back(make_pseudostate(suffix("p", i)));
+        f->sm.with_state(chain.back());
+    }
+    for(std::size_t i = 0; i < length; ++i)
+    {
+        auto p = f.get();
+        auto guard = [p]() {return ++p->counter > 0;};
+        if (i + 1 < length) {
+            chain[i].with_transition(suffix("p_2_p", i), chain[i + 1], guard);
+        } else {
+            chain[i].with_transition(suffix("p_2_s2", i), s2, guard);
+        }
+        chain[i].with_transition(suffix("p_2_s1", i), s1);
+    }
+    s1.with_transition("s1_2_p", chain.front(), f->sm.on_event("GO"));
+    s2.with_transition("s2_2_s1", s1, f->sm.on_event("GO"));
+    f->start();
+    return own(f);
+}
+
+const bool chain_registered = []() {
+    for(std::size_t length : {1, 4, 16})
+    {
+        bench::registrar(suffix("choice/chain", length), [length]() {
+            return chain(&fsm::make_choice_pseudostate, length);
+        });
+        bench::registrar(suffix("junction/chain", length), [length]() {
+            return chain(&fsm::make_junction_pseudostate, length);
+        });
+    }
+    return true;
+}();
+
+BENCHMARK("timeout/arm_cancel") {
+    // every event enters or leaves a state with a timeout transition, i.e. arms or cancels a timer
+    auto test = rxsc::make_test();
+    auto worker = test.create_worker();
+    auto f = std::make_shared<fixture>("TOGGLE");
+    auto initial = fsm::make_initial_pseudostate("initial");
+    auto s1 = fsm::make_state("s1");
+    auto s2 = fsm::make_state("s2");
+    initial.with_transition("initial_2_s1", s1);
+    s1.with_transition("s1_2_s2", s2, f->sm.on_event("TOGGLE"));
+    s2.with_transition("s2_2_s1", s1, f->sm.on_event("TOGGLE"));
+    s2.with_transition("s2_timeout", s1, rxcpp::observe_on_one_worker(test), std::chrono::hours(1));
+    f->sm.with_state(initial, s1, s2);
+    f->start();
+    auto b = f->fire();
+    return [f, b, worker](std::size_t n) mutable {
+        // lets virtual time pass the cancelled timers now and then, so that the queue of the scheduler stays short
+        const std::size_t batch = 256;
+        for(std::size_t done = 0; done < n; done += batch)
+        {
+            b(std::min(batch, n - done));
+            worker.advance_by(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::hours(2)).count());
+        }
+    };
+}
+
+const bool assemble_registered = []() {
+    for(std::size_t size : {16, 128, 1024})
+    {
+        // one event is defining, assembling, starting and terminating a machine of the specified number of states
+        bench::registrar(suffix("assemble/states", size), [size]() {
+            return [size](std::size_t n) {
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    fixture f("NEXT");
+                    auto initial = fsm::make_initial_pseudostate("initial");
+                    f.sm.with_state(initial);
+                    auto previous = fsm::make_state(suffix("s", 0));
+                    initial.with_transition("initial_2_s", previous);
+                    f.sm.with_state(previous);
+                    for(std::size_t s = 1; s < size; ++s)
+                    {
+                        auto current = fsm::make_state(suffix("s", s));
+                        previous.with_transition(suffix("s_2_s", s), current, f.sm.on_event("NEXT"));
+                        f.sm.with_state(current);
+                        previous = current;
+                    }
+                    f.start();
+                }
+            };
+        });
+    }
+    return true;
+}();
+
+}
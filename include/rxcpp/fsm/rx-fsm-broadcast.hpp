@@ -0,0 +1,155 @@
+/*! \file  rx-fsm-broadcast.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_BROADCAST_HPP)
+#define RX_FSM_BROADCAST_HPP
+
+#include "rx-fsm-event.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+struct broadcast_dispatcher_delegate
+{
+    typedef broadcast_dispatcher_delegate this_type;
+
+    // an event slot of a state machine currently having an active state triggered by the event
+    struct interested_slot : public event_source_node
+    {
+        std::shared_ptr<event_slot_base> slot;
+
+        explicit interested_slot(std::shared_ptr<event_slot_base> s)
+            : slot(std::move(s))
+        {
+        }
+    };
+
+    // event id -> the interested slots, registered in place, i.e. entering and exiting states never copies them
+    typedef std::unordered_map<event_id, event_source_registry*> interest_map;
+
+    // serializes the changes of interest, never taken by fire
+    std::mutex lock;
+    std::vector<std::unique_ptr<event_source_registry>> registries;
+    // replaced as a whole when an event is first added, a replaced map is kept since fire may still read it
+    std::vector<std::unique_ptr<const interest_map>> maps;
+    std::atomic<const interest_map*> interested;
+
+    event_source_registry& interest_of(const event_id& id);
+
+    void add_interest(const std::shared_ptr<event_slot_base>& slot);
+
+    void remove_interest(event_slot_base& slot);
+
+    event_source_registry* interested_slots(const event_id& id) const;
+
+    broadcast_dispatcher_delegate();
+
+    std::size_t interested_count(const event_id& id) const;
+};
+
+}
+
+/*!  \brief  Dispatcher of events shared by many state machines.
+
+     A state machine is attached to the dispatcher by \a state_machine::with_broadcast_dispatcher. The dispatcher
+     keeps an index from event identifier to the attached state machines whose active state configuration currently
+     handles the event, i.e. has a transition triggered by an observable returned by \a state_machine::on_event. The
+     index is updated as states are entered and exited, so a fired event only touches the interested state machines.
+     The interested state machines of an event are registered in place, as the subscribers of an \a event_source are,
+     i.e. firing an event takes no lock and entering or exiting a state does not copy the index. Events declared
+     through a sub machine are dispatched by the dispatcher of its root state machine.
+
+     \note  The class uses reference semantics.
+ */
+class broadcast_dispatcher final
+{
+public:
+
+    typedef broadcast_dispatcher this_type;
+    typedef detail::broadcast_dispatcher_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit broadcast_dispatcher(std::shared_ptr<delegate_type> d);
+
+    friend broadcast_dispatcher make_broadcast_dispatcher();
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \brief  Fires an event to all state machines currently interested in it.
+
+         \tparam T  The payload type, must be the same as the one the event was declared with.
+
+         \param id       The event identifier.
+         \param payload  The event payload.
+
+         \return  The number of state machines the event was delivered to.
+     */
+    template<class T>
+    std::size_t fire(const event_id& id, const T& payload) const
+    {
+        auto* registry = delegate->interested_slots(id);
+        if (!registry) {
+            return 0;
+        }
+        std::size_t delivered(0);
+        bool mismatch(false);
+        registry->for_each([&](detail::event_source_node& n) {
+            const auto& slot = static_cast<delegate_type::interested_slot&>(n).slot;
+            if (slot->type != typeid(T)) {
+                mismatch = true;
+                return;
+            }
+            static_cast<detail::event_slot<T>*>(slot.get())->subject.get_subscriber().on_next(payload);
+            ++delivered;
+        });
+        if (mismatch) {
+            std::ostringstream msg;
+            msg << "cannot broadcast event '" << id.name() << "' with another payload type than declared";
+            throw not_allowed(msg.str());
+        }
+        return delivered;
+    }
+
+    /*!  \brief  Fires an event without payload, i.e. with the identifier as payload, to all state machines currently interested in it.
+
+         \param id  The event identifier.
+
+         \return  The number of state machines the event was delivered to.
+     */
+    std::size_t fire(const event_id& id) const;
+
+    /*!  \return  The number of state machines currently interested in the event \a id.
+     */
+    std::size_t interested(const event_id& id) const;
+};
+
+/*!  \brief Creates a broadcast dispatcher.
+
+     \return  A \a broadcast_dispatcher instance.
+ */
+broadcast_dispatcher make_broadcast_dispatcher();
+
+}
+}
+
+#endif
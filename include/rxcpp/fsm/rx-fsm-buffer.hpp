@@ -0,0 +1,198 @@
+/*! \file  rx-fsm-buffer.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_BUFFER_HPP)
+#define RX_FSM_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Allocation information of a buffer pool.
+ */
+struct buffer_pool_stats
+{
+    /*!  Number of buffers allocated from the system allocator.
+     */
+    std::size_t allocated;
+
+    /*!  Number of buffers handed out again after being released.
+     */
+    std::size_t recycled;
+
+    /*!  Number of released buffers currently kept for reuse.
+     */
+    std::size_t cached;
+};
+
+namespace detail {
+
+struct buffer_pool_delegate;
+
+struct buffer_block
+{
+    std::atomic<std::size_t> references;
+    std::vector<std::uint8_t> bytes;
+    // keeps the pool alive while the block is handed out, reset while the block is cached
+    std::shared_ptr<buffer_pool_delegate> pool;
+};
+
+struct buffer_pool_delegate : public std::enable_shared_from_this<buffer_pool_delegate>
+{
+    typedef buffer_pool_delegate this_type;
+
+    mutable std::mutex lock;
+    std::size_t max_cached;
+    std::vector<buffer_block*> cached;
+    buffer_pool_stats counters;
+
+    buffer_block* acquire(std::size_t size);
+
+    void release(buffer_block* block);
+
+    explicit buffer_pool_delegate(std::size_t max);
+
+    ~buffer_pool_delegate();
+};
+
+}
+
+/*!  \brief  Immutable, reference counted sequence of bytes, e.g. a message used as event payload.
+
+     Copying a buffer only increments a reference count, i.e. a buffer fired as event reaches guards and actions
+     without its bytes being copied. When the last copy is destructed the storage is returned to the buffer pool it
+     was taken from, and reused by a later buffer.
+
+     \note  The class uses reference semantics.
+ */
+class buffer final
+{
+public:
+
+    typedef buffer this_type;
+
+    /*!  \brief  Creates an empty buffer.
+     */
+    buffer();
+
+    /*!  \brief  Takes over a reference to a block of a buffer pool.
+     */
+    explicit buffer(detail::buffer_block* b);
+
+    buffer(const buffer& other);
+
+    buffer(buffer&& other);
+
+    buffer& operator=(buffer other);
+
+    ~buffer();
+
+    /*!  \return  A pointer to the first byte, or nullptr if the buffer is empty.
+     */
+    const std::uint8_t* data() const
+    {
+        return block ? block->bytes.data() : nullptr;
+    }
+
+    /*!  \return  The number of bytes.
+     */
+    std::size_t size() const
+    {
+        return block ? block->bytes.size() : 0;
+    }
+
+    /*!  \return  True if the buffer has no bytes.
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+
+    detail::buffer_block* block;
+};
+
+/*!  \brief  Pool of buffers, recycling the storage of released buffers.
+
+     \note  The class uses reference semantics and is thread safe.
+ */
+class buffer_pool final
+{
+public:
+
+    typedef buffer_pool this_type;
+    typedef detail::buffer_pool_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit buffer_pool(std::shared_ptr<delegate_type> d);
+
+    friend buffer_pool make_buffer_pool(std::size_t max_cached);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \brief  Creates a buffer by writing its bytes in place, i.e. without an intermediate copy.
+
+         \param size    The number of bytes.
+         \param writer  Function with the signature void(std::uint8_t*), writing \a size bytes.
+
+         \return  The buffer.
+     */
+    template<class Writer>
+    buffer fill(std::size_t size, Writer writer) const
+    {
+        buffer b(delegate->acquire(size));
+        writer(const_cast<std::uint8_t*>(b.data()));
+        return b;
+    }
+
+    /*!  \brief  Creates a buffer holding a copy of a sequence of bytes.
+
+         \param data  The bytes to copy.
+         \param size  The number of bytes.
+
+         \return  The buffer.
+     */
+    buffer copy(const void* data, std::size_t size) const;
+
+    /*!  \return  The allocation statistics of the pool.
+     */
+    buffer_pool_stats stats() const;
+};
+
+/*!  \brief Creates a buffer pool.
+
+     \param max_cached  The maximum number of released buffers kept for reuse.
+
+     \return  A \a buffer_pool instance.
+ */
+buffer_pool make_buffer_pool(std::size_t max_cached = 64);
+
+}
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*! \file  rx-fsm-busy_poll.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_BUSY_POLL_HPP)
+#define RX_FSM_BUSY_POLL_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Run time statistics of a \a busy_poll executor.
+ */
+struct busy_poll_stats
+{
+    /*!  Number of actions executed.
+     */
+    std::uint64_t executed;
+
+    /*!  Number of times the executor parked, i.e. the spin budget was exhausted without any action to execute.
+     */
+    std::uint64_t parks;
+
+    /*!  Time spent executing actions.
+     */
+    std::chrono::nanoseconds working;
+
+    /*!  Time spent polling for actions without finding any.
+     */
+    std::chrono::nanoseconds spinning;
+
+    /*!  Time spent parked.
+     */
+    std::chrono::nanoseconds parked;
+};
+
+namespace detail {
+
+struct busy_poll_delegate;
+
+}
+
+/*!  \brief  Low latency executor, busy polling for actions before parking.
+
+     The executor runs one thread, which keeps polling its inbox for a configurable spin budget after the last action
+     was executed, and only then parks on a condition variable. While spinning, an action posted by another thread is
+     picked up without the wake up latency of a condition variable. The thread may be pinned to a core.
+
+     The executor is a coordination, and can be passed to \a state_machine::assemble, \a state_machine::start, as well
+     as to timeout transitions. All workers created from it execute on its single thread.
+
+     \note  The class uses reference semantics.
+ */
+class busy_poll final : public identity_one_worker
+{
+public:
+
+    typedef busy_poll this_type;
+    typedef detail::busy_poll_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit busy_poll(std::shared_ptr<delegate_type> d);
+
+    friend busy_poll make_busy_poll(std::chrono::nanoseconds spin_budget, int core);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \return  The run time statistics.
+     */
+    busy_poll_stats stats() const;
+};
+
+/*!  \brief Creates a busy polling executor.
+
+     \param spin_budget  Time to poll for actions after the last action executed, before parking.
+     \param core         The core to pin the executor thread to, or a negative value to not pin it.
+
+     \return  A \a busy_poll instance.
+ */
+busy_poll make_busy_poll(std::chrono::nanoseconds spin_budget = std::chrono::microseconds(100), int core = -1);
+
+}
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*! \file  rx-fsm-chrome_trace.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_CHROME_TRACE_HPP)
+#define RX_FSM_CHROME_TRACE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+
+#include "rx-fsm-tracer.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+struct chrome_trace_delegate final : public tracer
+{
+    typedef chrome_trace_delegate this_type;
+
+    enum kind_t : std::uint8_t { assembled_kind, guard_kind, action_kind, entered_kind, exited_kind, history_kind, region_kind, ignored_kind, unhandled_kind };
+
+    // one trace point, formatted by the writer thread
+    struct record
+    {
+        kind_t kind;
+        bool flag;
+        std::uint32_t machine;
+        // vertex or transition
+        std::uint32_t id;
+        std::uint64_t start;
+        std::uint64_t end;
+        std::uint64_t value;
+    };
+
+    struct machine_names
+    {
+        std::string name;
+        std::vector<std::string> vertices;
+        std::vector<std::string> transitions;
+    };
+
+    // the trace points of one thread, a single producer single consumer ring drained by the writer
+    struct thread_buffer
+    {
+        std::unique_ptr<record[]> records;
+        // written by the producing thread
+        std::atomic<std::uint64_t> head;
+        // written by the thread draining, under write_lock
+        std::atomic<std::uint64_t> tail;
+        // the producing thread exited, i.e. the buffer is dropped once drained
+        std::atomic<bool> orphaned;
+        // the tracer is destroyed, i.e. the producing thread drops the buffer
+        std::atomic<bool> released;
+
+        explicit thread_buffer(std::size_t capacity);
+    };
+
+    // distinguishes the buffers of the tracers in the threads, since addresses of destroyed tracers are reused
+    std::uint64_t id;
+    std::shared_ptr<std::ostream> out;
+    std::size_t sample_every;
+    std::size_t capacity;
+
+    std::mutex buffers_lock;
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    std::atomic<std::uint64_t> dropped;
+    std::atomic<bool> stopping;
+
+    // wakes the writer when a buffer is half full
+    std::mutex lock;
+    std::condition_variable wake;
+    std::atomic<bool> half_full;
+
+    std::mutex names_lock;
+    std::unordered_map<std::uint32_t, machine_names> names;
+
+    // the output is written by one thread at a time
+    std::mutex write_lock;
+    bool first;
+    bool closed;
+    std::thread writer;
+
+    // the buffer of the calling thread, added on its first trace point
+    thread_buffer& local();
+
+    void push(const record& r);
+
+    void run();
+
+    void drain();
+
+    void write(const record& r);
+
+    void flush();
+
+    void close();
+
+    virtual void assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions) override;
+
+    virtual bool sample(std::uint32_t machine, std::uint64_t step) override;
+
+    virtual void guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed) override;
+
+    virtual void action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition) override;
+
+    virtual void state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state) override;
+
+    virtual void state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered) override;
+
+    virtual void history_restored(std::uint32_t machine, std::uint64_t time, std::uint32_t history, std::size_t states) override;
+
+    virtual void region_completed(std::uint32_t machine, std::uint64_t time, std::uint32_t vertex, bool completed) override;
+
+    virtual void event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event) override;
+
+    virtual void event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state) override;
+
+    chrome_trace_delegate(std::shared_ptr<std::ostream> o, std::size_t sample_every, std::size_t capacity);
+
+    virtual ~chrome_trace_delegate();
+};
+
+}
+
+/*!  \brief  Exporter of the execution of state machines as Chrome Trace Event JSON, e.g. for Perfetto or chrome://tracing.
+
+     Every state machine the tracer (see \a get_tracer) is attached to appears as a thread of its own. The time a state
+     is active is a slice named by the hierarchical name of the state, i.e. nested in the slice of its parent state,
+     with its entry and exit actions as nested slices. Transitions are instant events named by the hierarchical name of
+     the transition, and their actions and guards slices with their durations.
+
+     Only every n:th run to completion step of a state machine is traced, and the trace points are collected in a
+     bounded buffer per thread that is written to the output by a background thread, i.e. the threads tracing never
+     contend. Trace points are dropped if the buffer of their thread is full, see \a dropped. The JSON document is completed by \a close, or when the last reference is released.
+
+     \note  The class uses reference semantics. The trace points are only invoked if the library is built with
+            RXCPP_FSM_TRACING defined.
+ */
+class chrome_trace final
+{
+public:
+
+    typedef chrome_trace this_type;
+    typedef detail::chrome_trace_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit chrome_trace(std::shared_ptr<delegate_type> d);
+
+    friend chrome_trace make_chrome_trace(std::shared_ptr<std::ostream> out, std::size_t sample_every, std::size_t capacity);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \return  The tracer to attach to state machines, see \a state_machine::with_tracer.
+     */
+    std::shared_ptr<tracer> get_tracer() const;
+
+    /*!  \brief  Writes all buffered trace points to the output.
+     */
+    void flush() const;
+
+    /*!  \brief  Stops the background thread and completes the JSON document, later trace points are ignored.
+     */
+    void close() const;
+
+    /*!  \return  The number of trace points dropped since the buffer was full.
+     */
+    std::uint64_t dropped() const;
+};
+
+/*! \brief Creates a Chrome trace exporter writing to a stream.
+
+    \param out           The stream to write the JSON document to.
+    \param sample_every  Trace one of every \a sample_every steps of a state machine, 1 traces all steps.
+    \param capacity      The maximum number of trace points buffered per thread until written.
+
+    \return  A \a chrome_trace instance.
+ */
+chrome_trace make_chrome_trace(std::shared_ptr<std::ostream> out, std::size_t sample_every = 1, std::size_t capacity = 16384);
+
+/*! \brief Creates a Chrome trace exporter writing to a file.
+
+    \param path          The path of the file to write the JSON document to, replaced if it exists.
+    \param sample_every  Trace one of every \a sample_every steps of a state machine, 1 traces all steps.
+    \param capacity      The maximum number of trace points buffered per thread until written.
+
+    \return  A \a chrome_trace instance.
+ */
+chrome_trace make_chrome_trace(const std::string& path, std::size_t sample_every = 1, std::size_t capacity = 16384);
+
+}
+}
+
+#endif
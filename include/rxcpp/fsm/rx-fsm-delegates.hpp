@@ -9,6 +9,8 @@
 #if !defined(RX_FSM_DELEGATES_HPP)
 #define RX_FSM_DELEGATES_HPP
 
+#include <cstdint>
+
 #include "rx-fsm-predef.hpp"
 
 namespace rxcpp {
@@ -20,12 +22,18 @@ namespace detail {
 struct transition_delegate;
 struct virtual_vertex_delegate;
 
+const std::size_t no_index = static_cast<std::size_t>(-1);
+
 struct virtual_region_delegate : public element_delegate
 {
     typedef virtual_region_delegate this_type;
 
     std::vector<std::shared_ptr<virtual_vertex_delegate>> sub_states;
 
+    // indices of the history records of the region, assigned when the state machine is assembled
+    std::size_t shallow_history;
+    std::size_t deep_history;
+
     bool contains(const std::shared_ptr<virtual_vertex_delegate>& sub_state) const;
 
     explicit virtual_region_delegate(std::string n, const std::shared_ptr<element_delegate>& o);
@@ -43,6 +51,9 @@ struct virtual_vertex_delegate : public element_delegate
 
     std::vector<std::shared_ptr<transition_delegate>> transitions;
 
+    // index of the vertex, assigned when the state machine is assembled
+    std::uint32_t id;
+
     void add_transition(const std::shared_ptr<transition_delegate>& t);
 
     virtual void check_transition_target(const std::shared_ptr<transition_delegate>& t) const = 0;
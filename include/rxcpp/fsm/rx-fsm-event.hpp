@@ -0,0 +1,212 @@
+/*! \file  rx-fsm-event.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_EVENT_HPP)
+#define RX_FSM_EVENT_HPP
+
+#include <cstdint>
+#include <typeinfo>
+
+#include "rx-fsm-predef.hpp"
+#include "rx-fsm-event_source.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Identifier of an event occurrence, either an interned string or a small integer.
+
+     String identifiers are interned in a process wide table, i.e. two identifiers created from equal strings are
+     equal and comparing them is a single integer comparison.
+
+     \note  The class uses value semantics and is eqaulity comparable, and can be used as keys in maps, sets including unordered.
+ */
+class event_id final
+{
+public:
+
+    typedef event_id this_type;
+
+    /*!  \brief  Creates an identifier from an interned string.
+
+         \param name  The name of the event.
+     */
+    event_id(const std::string& name);
+
+    /*!  \brief  Creates an identifier from an interned string.
+
+         \param name  The name of the event.
+     */
+    event_id(const char* name);
+
+    /*!  \brief  Creates an identifier from an integer.
+
+         \param value  The integer value of the event. The most significant bit is reserved for interned strings.
+     */
+    explicit event_id(std::uint64_t value);
+
+    /*!  \return  The integer value of the identifier.
+     */
+    std::uint64_t value() const
+    {
+        return value_;
+    }
+
+    /*!  \return  True if the identifier was created from a string.
+     */
+    bool is_interned() const;
+
+    /*!  \return  The interned string, or the integer value as a string.
+     */
+    std::string name() const;
+
+private:
+
+    std::uint64_t value_;
+};
+
+inline bool operator==(const event_id& lhs, const event_id& rhs)
+{
+    return lhs.value() == rhs.value();
+}
+
+inline bool operator!=(const event_id& lhs, const event_id& rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline bool operator<(const event_id& lhs, const event_id& rhs)
+{
+    return lhs.value() < rhs.value();
+}
+
+/*!  \brief  Size information of the event dispatch table generated when a state machine is assembled.
+ */
+struct event_table_stats
+{
+    /*!  Number of distinct event identifiers, i.e. number of slots in the table.
+     */
+    std::size_t events;
+
+    /*!  Number of displacement buckets of the perfect hash.
+     */
+    std::size_t buckets;
+
+    /*!  Approximate number of bytes occupied by the table, excluding the per event subjects.
+     */
+    std::size_t bytes;
+};
+
+namespace detail {
+
+struct broadcast_dispatcher_delegate;
+
+struct event_slot_base : public std::enable_shared_from_this<event_slot_base>
+{
+    event_id id;
+    const std::type_info& type;
+
+    // interest bookkeeping, guarded by the dispatcher
+    std::weak_ptr<broadcast_dispatcher_delegate> dispatcher;
+    std::size_t subscribers;
+    event_source_registry::handle interest;
+
+    void interest_added();
+
+    void interest_removed();
+
+    explicit event_slot_base(event_id i, const std::type_info& t);
+
+    virtual ~event_slot_base() = default;
+};
+
+template<class T>
+struct event_slot : public event_slot_base
+{
+    composite_subscription lifetime;
+    subjects::subject<T> subject;
+
+    explicit event_slot(event_id i)
+        : event_slot_base(std::move(i), typeid(T))
+        , subject(lifetime)
+    {
+    }
+
+    observable<T> get_observable()
+    {
+        std::weak_ptr<event_slot_base> weak = this->shared_from_this();
+        return observable<>::create<T>([weak](subscriber<T> s) {
+            auto self = weak.lock();
+            if (!self) {
+                return;
+            }
+            self->interest_added();
+            s.add([weak]() {
+                auto self = weak.lock();
+                if (self) {
+                    self->interest_removed();
+                }
+            });
+            static_cast<event_slot<T>*>(self.get())->subject.get_observable().subscribe(s);
+        }).as_dynamic();
+    }
+
+    virtual ~event_slot() override
+    {
+        lifetime.unsubscribe();
+    }
+};
+
+/*  Minimal perfect hash over the event identifiers of a state machine (hash and displace). Every identifier
+    is resolved to its slot by one bucket lookup and one slot probe.
+ */
+class event_table
+{
+public:
+
+    void build(std::vector<std::shared_ptr<event_slot_base>> s);
+
+    event_slot_base* find(const event_id& id) const
+    {
+        if (slots.empty()) {
+            return nullptr;
+        }
+        auto d = displacements[bucket(id.value())];
+        auto* slot = slots[position(id.value(), d)].get();
+        return slot->id == id ? slot : nullptr;
+    }
+
+    event_table_stats stats() const;
+
+private:
+
+    std::size_t bucket(std::uint64_t key) const;
+
+    std::size_t position(std::uint64_t key, std::uint32_t displacement) const;
+
+    std::vector<std::uint32_t> displacements;
+    std::vector<std::shared_ptr<event_slot_base>> slots;
+};
+
+}
+}
+}
+
+namespace std
+{
+template <>
+struct hash<rxcpp::fsm::event_id>
+{
+    size_t operator()(const rxcpp::fsm::event_id& e) const noexcept
+    {
+        return std::hash<std::uint64_t>()(e.value());
+    }
+};
+}
+
+#endif
@@ -0,0 +1,266 @@
+/*! \file  rx-fsm-event_source.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_EVENT_SOURCE_HPP)
+#define RX_FSM_EVENT_SOURCE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+struct event_source_node
+{
+    virtual ~event_source_node() = default;
+};
+
+/*  Subscriber registry of an event source.
+
+    Subscribers occupy slots in segments that are never moved or freed while the registry lives, and each slot
+    has a generation counter that is bumped whenever the slot is taken or released, so that stale handles are
+    detected. Readers iterate the slots without locking. A released subscriber node is retired and deleted when
+    no reader that may have observed it remains, which is tracked by two epoch parities (epoch based reclamation).
+    Writers, i.e. subscribe and unsubscribe, are serialized by a mutex.
+ */
+class event_source_registry
+{
+public:
+
+    struct handle
+    {
+        std::size_t index;
+        std::uint64_t generation;
+    };
+
+    handle add(std::unique_ptr<event_source_node> node);
+
+    void remove(const handle& h);
+
+    template<class F>
+    void for_each(F f)
+    {
+        // left also when f throws, a reader never leaving would stop the reclamation
+        struct reader
+        {
+            event_source_registry* registry;
+            std::size_t parity;
+
+            ~reader()
+            {
+                registry->exit(parity);
+            }
+        } r = {this, enter()};
+        // subscribers added while iterating, e.g. by a transition, do not receive the current event
+        auto last = sequence.load();
+        auto n = high_water.load();
+        std::size_t start(0);
+        for(std::size_t k = 0; k < segment_count && start < n; ++k)
+        {
+            auto* segment = segments[k].load();
+            if (!segment) {
+                break;
+            }
+            auto count = std::min(segment_size(k), n - start);
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                auto* node = segment[i].node.load();
+                if (node && segment[i].added.load() <= last) {
+                    f(*node);
+                }
+            }
+            start += count;
+        }
+    }
+
+    std::size_t size() const;
+
+    event_source_registry();
+
+    ~event_source_registry();
+
+private:
+
+    struct slot
+    {
+        std::atomic<std::uint64_t> generation;
+        std::atomic<std::uint64_t> added;
+        std::atomic<event_source_node*> node;
+    };
+
+    // segment k holds (first_segment_size << k) slots
+    static const std::size_t segment_count = 26;
+    static const std::size_t first_segment_size = 64;
+
+    static std::size_t segment_size(std::size_t k)
+    {
+        return first_segment_size << k;
+    }
+
+    slot& at(std::size_t index);
+
+    std::size_t enter()
+    {
+        auto parity = static_cast<std::size_t>(epoch.load() & 1);
+        readers[parity].fetch_add(1);
+        return parity;
+    }
+
+    void exit(std::size_t parity)
+    {
+        readers[parity].fetch_sub(1);
+        if (retired_count.load(std::memory_order_relaxed) > 0) {
+            std::unique_lock<std::mutex> guard(writer, std::try_to_lock);
+            if (guard.owns_lock()) {
+                reclaim();
+            }
+        }
+    }
+
+    // must be called with writer locked
+    void reclaim();
+
+    std::atomic<slot*> segments[segment_count];
+    std::atomic<std::size_t> high_water;
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> epoch;
+    std::atomic<std::size_t> readers[2];
+    std::atomic<std::size_t> retired_count;
+
+    std::mutex writer;
+    std::size_t count;
+    std::vector<std::size_t> free_slots;
+    std::vector<event_source_node*> retired[2];
+};
+
+}
+
+/*!  \brief  Event source optimized for frequent subscribe and unsubscribe, e.g. as trigger of transitions.
+
+     A drop-in alternative to \a rxcpp::subjects::subject for transition triggers. Entering and exiting states
+     subscribes and unsubscribes the trigger, which for a subject means mutating its subscriber list under a mutex that
+     every on_next also takes. An event source registers subscribers in slots with generation counters, iterates them
+     wait-free on on_next, and reclaims unsubscribed slots using epochs, so on_next never blocks on subscription changes.
+
+     \tparam T  The type of the events.
+
+     \note  The class uses reference semantics.
+ */
+template<class T>
+class event_source final
+{
+public:
+
+    typedef T value_type;
+    typedef event_source<T> this_type;
+
+private:
+
+    struct node : public detail::event_source_node
+    {
+        subscriber<T> destination;
+
+        explicit node(subscriber<T> d)
+            : destination(std::move(d))
+        {
+        }
+    };
+
+    std::shared_ptr<detail::event_source_registry> registry;
+
+public:
+
+    event_source()
+        : registry(std::make_shared<detail::event_source_registry>())
+    {
+    }
+
+    /*!  \brief  Returns an observable of the events of this source, usable wherever a trigger observable is accepted.
+
+         \return  The observable.
+     */
+    observable<T> get_observable() const
+    {
+        std::weak_ptr<detail::event_source_registry> weak = registry;
+        return observable<>::create<T>([weak](subscriber<T> s) {
+            auto r = weak.lock();
+            if (!r) {
+                s.on_completed();
+                return;
+            }
+            auto h = r->add(std::unique_ptr<detail::event_source_node>(new node(s)));
+            s.add([weak, h]() {
+                auto r = weak.lock();
+                if (r) {
+                    r->remove(h);
+                }
+            });
+        }).as_dynamic();
+    }
+
+    /*!  \brief  Emits an event to all current subscribers.
+
+         \param v  The event.
+     */
+    void on_next(const T& v) const
+    {
+        registry->for_each([&v](detail::event_source_node& n) {
+            const auto& d = static_cast<node&>(n).destination;
+            if (d.is_subscribed()) {
+                d.on_next(v);
+            }
+        });
+    }
+
+    /*!  \brief  Emits an error to all current subscribers.
+
+         \param e  The error.
+     */
+    void on_error(std::exception_ptr e) const
+    {
+        registry->for_each([&e](detail::event_source_node& n) {
+            const auto& d = static_cast<node&>(n).destination;
+            if (d.is_subscribed()) {
+                d.on_error(e);
+            }
+        });
+    }
+
+    /*!  \brief  Completes all current subscribers.
+     */
+    void on_completed() const
+    {
+        registry->for_each([](detail::event_source_node& n) {
+            const auto& d = static_cast<node&>(n).destination;
+            if (d.is_subscribed()) {
+                d.on_completed();
+            }
+        });
+    }
+
+    /*!  \return  The number of current subscribers.
+     */
+    std::size_t subscriber_count() const
+    {
+        return registry->size();
+    }
+};
+
+}
+}
+
+#endif
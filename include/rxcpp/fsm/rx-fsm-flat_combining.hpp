@@ -0,0 +1,201 @@
+/*! \file  rx-fsm-flat_combining.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_FLAT_COMBINING_HPP)
+#define RX_FSM_FLAT_COMBINING_HPP
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+/*  Flat combiner, executes posted work strictly one at a time.
+
+    A producer publishes its work in a publication slot and then tries to become the combiner. The combiner executes
+    the work of all published slots in batches, while the other producers wait for their slots to be marked as done.
+    Work posted by the combiner itself, e.g. an action firing an event into the same state machine, is deferred to
+    the end of the work it was posted by instead of waiting (which would dead lock), and its errors are reported to
+    the producer of that work. Combines nest, e.g. when an action fires into another state machine that is combined
+    inline, so work posted while the combiner is anywhere on the stack of combines of the thread is deferred.
+ */
+class flat_combiner
+{
+public:
+
+    template<class F>
+    void post(F& f)
+    {
+        if (is_combining()) {
+            deferred.push_back(std::function<void()>(f));
+            return;
+        }
+        execute(&invoke<F>, &f);
+    }
+
+    flat_combiner();
+
+private:
+
+    template<class F>
+    static void invoke(void* f)
+    {
+        (*static_cast<F*>(f))();
+    }
+
+    void execute(void (*fn)(void*), void* context);
+
+    bool is_combining() const;
+
+    void combine();
+
+    enum slot_state
+    {
+        empty,
+        claimed,
+        published,
+        done
+    };
+
+    struct slot
+    {
+        std::atomic<int> state;
+        void (*fn)(void*);
+        void* context;
+        std::exception_ptr error;
+        // keep slots of different producers on different cache lines
+        char padding[64];
+    };
+
+    static const std::size_t slot_count = 64;
+    static const int max_passes = 16;
+
+    slot slots[slot_count];
+    std::mutex lock;
+    // only accessed by the combiner
+    std::deque<std::function<void()>> deferred;
+
+    // the combines of the calling thread, innermost first, restored when a combine ends, also by an exception
+    struct combining_scope
+    {
+        const flat_combiner* combiner;
+        const combining_scope* outer;
+
+        explicit combining_scope(const flat_combiner* c);
+        ~combining_scope();
+    };
+
+    static thread_local const combining_scope* combining;
+};
+
+}
+
+/*!  \brief  Flat combining dispatch of a state machine, an alternative to a serialized coordination.
+
+     When a state machine is assembled with this coordination, events are not queued onto a worker thread. Instead
+     the producing thread publishes the event in a per-thread slot and whichever producer acquires the combiner role
+     executes a batch of run-to-completion steps, including the ones published by other producers. Waiting producers
+     are released when their events have been processed. This avoids the convoy on the queue and mutex of a serialized
+     coordination when many threads fire events into the same machine.
+
+     Actions are executed on the producing threads, but never concurrently.
+
+     \note  The class uses reference semantics.
+ */
+class flat_combining : public identity_one_worker
+{
+public:
+
+    typedef flat_combining this_type;
+
+private:
+
+    std::shared_ptr<detail::flat_combiner> combiner_;
+
+public:
+
+    flat_combining();
+
+    /*!  \brief  Returns the implementation specific combiner object.
+
+         \return  The implementation specific combiner object.
+     */
+    const std::shared_ptr<detail::flat_combiner>& combiner() const
+    {
+        return combiner_;
+    }
+};
+
+/*!  \brief Creates a flat combining coordination, to be used when assembling a state machine.
+
+     \return  A \a flat_combining instance.
+ */
+flat_combining make_flat_combining();
+
+namespace detail {
+
+template<class Coordination, class Observable>
+auto dispatch_on(const Coordination& cn, Observable o)
+    -> decltype(o.observe_on(cn))
+{
+    return o.observe_on(cn);
+}
+
+template<class Observable>
+observable<rxu::value_type_t<Observable>> dispatch_on(const flat_combining& cn, Observable o)
+{
+    typedef rxu::value_type_t<Observable> value_type;
+    auto combiner = cn.combiner();
+    return o.template lift<value_type>([combiner](subscriber<value_type> dest) {
+        return make_subscriber<value_type>(dest,
+            [combiner, dest](const value_type& v) {
+                auto f = [dest, v]() {
+                    dest.on_next(v);
+                };
+                combiner->post(f);
+            },
+            [combiner, dest](std::exception_ptr e) {
+                auto f = [dest, e]() {
+                    dest.on_error(e);
+                };
+                combiner->post(f);
+            },
+            [combiner, dest]() {
+                auto f = [dest]() {
+                    dest.on_completed();
+                };
+                combiner->post(f);
+            });
+    }).as_dynamic();
+}
+
+template<class Coordination, class F>
+void run_on(const Coordination&, F& f)
+{
+    f();
+}
+
+template<class F>
+void run_on(const flat_combining& cn, F& f)
+{
+    cn.combiner()->post(f);
+}
+
+}
+}
+}
+
+#endif
@@ -17,12 +17,26 @@
 
 #include "rxcpp/rx.hpp"
 #include "rx-fsm-predef.hpp"
+#include "rx-fsm-broadcast.hpp"
+#include "rx-fsm-buffer.hpp"
+#include "rx-fsm-busy_poll.hpp"
+#include "rx-fsm-chrome_trace.hpp"
 #include "rx-fsm-delegates.hpp"
+#include "rx-fsm-event.hpp"
+#include "rx-fsm-event_source.hpp"
+#include "rx-fsm-flat_combining.hpp"
+#include "rx-fsm-metrics.hpp"
+#include "rx-fsm-pool.hpp"
 #include "rx-fsm-region.hpp"
+#include "rx-fsm-sharded_runtime.hpp"
+#include "rx-fsm-tracer.hpp"
 #include "rx-fsm-transition.hpp"
 #include "rx-fsm-vertex.hpp"
+#include "rx-fsm-virtual_time.hpp"
 #include "rx-fsm-pseudostate.hpp"
 #include "rx-fsm-state.hpp"
 #include "rx-fsm-state_machine.hpp"
+#include "rx-fsm-openmetrics.hpp"
+#include "rx-fsm-work_stealing.hpp"
 
 #endif
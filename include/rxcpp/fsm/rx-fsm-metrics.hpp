@@ -0,0 +1,264 @@
+/*! \file  rx-fsm-metrics.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_METRICS_HPP)
+#define RX_FSM_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "rx-fsm-tracer.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+struct metrics_delegate;
+
+}
+
+/*!  \brief  Distribution of durations in nanoseconds, in buckets of powers of two.
+
+     Bucket 0 counts durations of 0 ns, and bucket i > 0 durations within [2^(i-1), 2^i) ns, except the last bucket,
+     which counts all durations from 2^(bucket_count-2) ns, i.e. about 275 s.
+ */
+class duration_histogram final
+{
+public:
+
+    static const std::size_t bucket_count = 40;
+
+    duration_histogram();
+
+    /*!  \return  The number of durations recorded.
+     */
+    std::uint64_t count() const;
+
+    /*!  \return  The sum of all durations recorded, in nanoseconds.
+     */
+    std::uint64_t sum() const;
+
+    /*!  \return  The mean duration in nanoseconds, 0 if none is recorded.
+     */
+    double mean() const;
+
+    /*!  \return  The number of durations recorded in a bucket.
+     */
+    std::uint64_t bucket(std::size_t i) const;
+
+    /*!  \return  The highest duration counted by a bucket, in nanoseconds.
+     */
+    static std::uint64_t upper_bound(std::size_t i);
+
+    /*!  \param p  The percentile, within 0..100.
+
+         \return  The upper bound of the bucket of the duration at the percentile, 0 if none is recorded.
+     */
+    std::uint64_t percentile(double p) const;
+
+private:
+
+    std::array<std::uint64_t, bucket_count> buckets;
+    std::uint64_t total;
+
+    friend struct detail::metrics_delegate;
+};
+
+/*!  \brief  Metrics of a vertex of a state machine.
+ */
+struct state_metrics
+{
+    /*!  The hierarchical name of the vertex, i.e. the names of its owning states and regions separated by '/'.
+     */
+    std::string name;
+
+    /*!  Number of times the state was entered.
+     */
+    std::uint64_t entered;
+
+    /*!  Number of times the state was exited.
+     */
+    std::uint64_t exited;
+
+    /*!  Number of times a trigger of the state emitted, but the guards of all its transitions failed.
+     */
+    std::uint64_t unhandled;
+
+    /*!  Execution time of the entry action.
+     */
+    duration_histogram entry;
+
+    /*!  Execution time of the exit action.
+     */
+    duration_histogram exit;
+
+    /*!  Time from the start of the entry action until the end of the exit action.
+     */
+    duration_histogram dwell;
+};
+
+/*!  \brief  Metrics of a transition of a state machine.
+ */
+struct transition_metrics
+{
+    /*!  The hierarchical name of the transition, i.e. the names of its source and owners separated by '/'.
+     */
+    std::string name;
+
+    /*!  The vertex id of the source of the transition.
+     */
+    std::uint32_t source;
+
+    /*!  True if the transition is a triggered or a timeout transition, i.e. subscribed to while its source is active.
+     */
+    bool triggered;
+
+    /*!  True if the transition is a timeout transition, i.e. armed whenever its source is entered.
+     */
+    bool timeout;
+
+    /*!  Number of times the transition fired, i.e. its action was executed.
+     */
+    std::uint64_t fired;
+
+    /*!  Number of times the guard of a triggered transition passed.
+     */
+    std::uint64_t guard_passed;
+
+    /*!  Number of times the guard of a triggered transition failed.
+     */
+    std::uint64_t guard_failed;
+
+    /*!  Execution time of the action.
+     */
+    duration_histogram action;
+
+    /*!  Execution time of the guard of a triggered transition.
+     */
+    duration_histogram guard;
+};
+
+/*!  \brief  Snapshot of the metrics of a state machine, see \a state_machine::metrics.
+ */
+struct metrics
+{
+    /*!  The name of the state machine.
+     */
+    std::string name;
+
+    /*!  Number of events fired that the state machine does not declare, or that no active state had a transition for.
+     */
+    std::uint64_t ignored;
+
+    /*!  Metrics of all vertices, pseudostates included, indexed by vertex id.
+     */
+    std::vector<state_metrics> states;
+
+    /*!  Metrics of all transitions, indexed by transition id.
+     */
+    std::vector<transition_metrics> transitions;
+
+    /*!  \return  The metrics of the vertex with the specified hierarchical name, or nullptr if not found.
+     */
+    const state_metrics* find_state(const std::string& n) const;
+
+    /*!  \return  The metrics of the transition with the specified hierarchical name, or nullptr if not found.
+     */
+    const transition_metrics* find_transition(const std::string& n) const;
+};
+
+namespace detail {
+
+// collects the metrics of one state machine in counters of the cores executing it, merged when read
+struct metrics_delegate final : public tracer
+{
+    typedef metrics_delegate this_type;
+
+    struct histogram_cells
+    {
+        std::atomic<std::uint64_t> buckets[duration_histogram::bucket_count];
+        std::atomic<std::uint64_t> total;
+    };
+
+    struct state_cells
+    {
+        std::atomic<std::uint64_t> entered, exited, unhandled;
+        histogram_cells entry, exit, dwell;
+    };
+
+    struct transition_cells
+    {
+        std::atomic<std::uint64_t> fired, guard_passed, guard_failed;
+        histogram_cells action, guard;
+    };
+
+    // the counters of one core, mostly updated by the thread running there, allocated per vertex and transition as
+    // they are executed on the core
+    struct shard
+    {
+        std::atomic<std::uint64_t> ignored;
+        std::unique_ptr<std::atomic<state_cells*>[]> states;
+        std::unique_ptr<std::atomic<transition_cells*>[]> transitions;
+        std::size_t state_count, transition_count;
+
+        shard(std::size_t states, std::size_t transitions);
+
+        ~shard();
+
+        state_cells& state(std::size_t i);
+
+        transition_cells& transition(std::size_t i);
+    };
+
+    // the layout, written once when the state machine is assembled and published by ready
+    std::string name;
+    std::vector<std::string> state_names, transition_names;
+    std::vector<std::uint32_t> transition_sources;
+    std::vector<bool> triggers, timeouts;
+    std::atomic<bool> ready;
+    // one shard per core, allocated as the core executes the state machine, i.e. bounded however many threads do,
+    // and neither the threads executing the state machine nor the readers of snapshots ever wait for each other
+    std::unique_ptr<std::atomic<shard*>[]> shards;
+    std::size_t shard_count;
+
+    // the shard of the core of the calling thread
+    shard& local();
+
+    static void add(duration_histogram& h, const histogram_cells& cells);
+
+    fsm::metrics snapshot() const;
+
+    virtual void assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions) override;
+
+    virtual void guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed) override;
+
+    virtual void action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition) override;
+
+    virtual void state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state) override;
+
+    virtual void state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered) override;
+
+    virtual void event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event) override;
+
+    virtual void event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state) override;
+
+    metrics_delegate();
+
+    virtual ~metrics_delegate();
+};
+
+}
+
+}
+}
+
+#endif
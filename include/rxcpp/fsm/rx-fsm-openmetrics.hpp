@@ -0,0 +1,198 @@
+/*! \file  rx-fsm-openmetrics.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_OPENMETRICS_HPP)
+#define RX_FSM_OPENMETRICS_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rx-fsm-metrics.hpp"
+#include "rx-fsm-sharded_runtime.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+class state_machine;
+
+namespace detail {
+
+struct openmetrics_delegate
+{
+    typedef openmetrics_delegate this_type;
+
+    // one registered state machine, alive or not yet retired
+    struct instance
+    {
+        std::weak_ptr<const state_machine_delegate> machine;
+        std::shared_ptr<metrics_delegate> metering;
+        std::size_t number;
+    };
+
+    struct retired_sum;
+
+    // the instances of one state machine definition, aggregated into one series per vertex and transition, the
+    // counters of the instances no longer alive are folded into retired, i.e. the series never decrease
+    struct definition
+    {
+        std::string name;
+        std::vector<instance> instances;
+        // the number of instances ever registered, numbering the instances
+        std::size_t registered;
+        std::shared_ptr<const retired_sum> retired;
+    };
+
+    struct runtime
+    {
+        std::string name;
+        sharded_runtime shards;
+    };
+
+    std::size_t max_instances;
+
+    // guards the registrations only, the metrics themselves are read without locking
+    mutable std::mutex lock;
+    // the expired instances are also retired when rendering
+    mutable std::vector<definition> definitions;
+    std::vector<runtime> runtimes;
+
+    // folds the instances no longer alive into the retired sum of their definition and drops them, under lock
+    static void retire_expired(definition& d);
+
+    void add(const state_machine& sm, const std::string& definition_name);
+
+    void add(const sharded_runtime& rt, const std::string& name);
+
+    void render(std::string& out) const;
+
+    explicit openmetrics_delegate(std::size_t max_instances);
+};
+
+}
+
+/*!  \brief  Exporter of the metrics of state machines and runtimes as OpenMetrics text, e.g. for Prometheus.
+
+     The instances of the same state machine definition are aggregated into one series per vertex and transition,
+     labelled \c definition, \c state and \c transition:
+        - \c rxcpp_fsm_transitions_total, the number of times each transition fired, i.e. \c rate() gives
+          transitions per second;
+        - \c rxcpp_fsm_active_states, the number of instances a state is active in;
+        - \c rxcpp_fsm_state_dwell_seconds, a histogram of the time states are active;
+        - \c rxcpp_fsm_timeout_fires_total and \c rxcpp_fsm_timeout_cancels_total, the number of times a timeout
+          transition fired, and was armed but its source was left by another transition;
+        - \c rxcpp_fsm_unhandled_events_total and \c rxcpp_fsm_ignored_events_total;
+        - \c rxcpp_fsm_live_subscriptions, the number of trigger subscriptions of the active states, i.e. one per
+          triggered or timeout transition;
+        - \c rxcpp_fsm_instances, the number of registered instances alive.
+
+     The counters of an instance destroyed are kept in the series of its definition, while the instance itself is
+     dropped, i.e. the exporter does not grow with the number of instances ever registered. Series per instance,
+     labelled \c definition and \c instance, are only rendered for the first instances alive of each definition,
+     i.e. the label cardinality is bounded whatever the number of instances.
+     The queue depth and the number of actions executed of every shard of a registered \a sharded_runtime are
+     rendered as \c rxcpp_fsm_shard_queue_depth and \c rxcpp_fsm_shard_executed_total.
+
+     Rendering reads the counters of the state machines without taking any lock their execution takes.
+
+     \note  The class uses reference semantics. State machines can only be registered if the library is built with
+            RXCPP_FSM_TRACING defined, see \a state_machine::with_metrics.
+ */
+class openmetrics_exporter final
+{
+public:
+
+    typedef openmetrics_exporter this_type;
+    typedef detail::openmetrics_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit openmetrics_exporter(std::shared_ptr<delegate_type> d);
+
+    friend openmetrics_exporter make_openmetrics_exporter(std::size_t max_instances);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \brief  Registers a state machine as an instance of the definition named as the state machine.
+
+         Enables the metrics of the state machine, see \a state_machine::with_metrics, unless already enabled.
+
+         \param sm  The state machine, not yet assembled unless its metrics are already enabled.
+
+         \return  A reference to self
+
+         \throw  not_allowed if the metrics cannot be enabled.
+     */
+    this_type& with_state_machine(state_machine& sm);
+
+    /*!  \brief  Registers a state machine as an instance of a definition.
+
+         Enables the metrics of the state machine, see \a state_machine::with_metrics, unless already enabled.
+
+         \param sm          The state machine, not yet assembled unless its metrics are already enabled.
+         \param definition  The name of the definition, i.e. shared by all state machines built alike.
+
+         \return  A reference to self
+
+         \throw  not_allowed if the metrics cannot be enabled.
+     */
+    this_type& with_state_machine(state_machine& sm, const std::string& definition);
+
+    /*!  \brief  Registers a sharded runtime, kept alive by the exporter.
+
+         \param rt    The runtime.
+         \param name  The name of the runtime, the value of the \c runtime label of its series.
+
+         \return  A reference to self
+     */
+    this_type& with_sharded_runtime(const sharded_runtime& rt, const std::string& name);
+
+    /*!  \brief  Renders a snapshot of the metrics.
+
+         \param out  The string to append the OpenMetrics text to, terminated by "# EOF".
+     */
+    void write(std::string& out) const;
+
+    /*!  \brief  Renders a snapshot of the metrics to a file descriptor, e.g. a socket or a pipe.
+
+         \param fd  The file descriptor to write the OpenMetrics text to, terminated by "# EOF".
+
+         \throw  std::system_error if writing fails.
+     */
+    void write(int fd) const;
+
+    /*!  \return  A snapshot of the metrics as OpenMetrics text.
+     */
+    std::string to_string() const;
+};
+
+/*! \brief Creates an OpenMetrics exporter.
+
+    \param max_instances  The maximum number of instances of each definition rendered with series of their own.
+
+    \return  An \a openmetrics_exporter instance.
+ */
+openmetrics_exporter make_openmetrics_exporter(std::size_t max_instances = 16);
+
+}
+}
+
+#endif
@@ -0,0 +1,136 @@
+/*! \file  rx-fsm-pool.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_POOL_HPP)
+#define RX_FSM_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Allocation information of the node pool of a state machine.
+ */
+struct node_pool_stats
+{
+    /*!  Number of nodes carved from the system allocator, i.e. the capacity of the pool.
+     */
+    std::size_t allocated;
+
+    /*!  Number of nodes currently in use, i.e. the number of active states and regions.
+     */
+    std::size_t in_use;
+
+    /*!  Highest number of nodes in use at the same time.
+     */
+    std::size_t high_water_mark;
+};
+
+namespace detail {
+
+/*  Free list of equally sized blocks. The block size is fixed by the first allocation, other sizes are passed
+    on to the system allocator. Blocks are carved from chunks that are kept until the pool is destructed, i.e.
+    a state machine that cycles through its states allocates nothing once the high water mark is reached.
+ */
+class node_pool
+{
+public:
+
+    void* allocate(std::size_t size);
+
+    void deallocate(void* p, std::size_t size);
+
+    node_pool_stats stats() const;
+
+    node_pool();
+
+    ~node_pool();
+
+private:
+
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    mutable std::mutex lock;
+    std::size_t block_size;
+    free_block* free_list;
+    std::vector<void*> chunks;
+    node_pool_stats counters;
+};
+
+template<class T>
+struct pool_allocator
+{
+    typedef T value_type;
+
+    std::shared_ptr<node_pool> pool;
+
+    explicit pool_allocator(std::shared_ptr<node_pool> p)
+        : pool(std::move(p))
+    {
+    }
+
+    template<class U>
+    pool_allocator(const pool_allocator<U>& other)
+        : pool(other.pool)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(pool->allocate(sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        pool->deallocate(p, sizeof(T));
+    }
+
+    template<class U>
+    struct rebind
+    {
+        typedef pool_allocator<U> other;
+    };
+};
+
+template<class T, class U>
+bool operator==(const pool_allocator<T>& lhs, const pool_allocator<U>& rhs)
+{
+    return lhs.pool == rhs.pool;
+}
+
+template<class T, class U>
+bool operator!=(const pool_allocator<T>& lhs, const pool_allocator<U>& rhs)
+{
+    return !(lhs == rhs);
+}
+
+}
+}
+}
+
+#endif
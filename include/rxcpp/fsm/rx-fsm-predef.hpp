@@ -10,6 +10,8 @@
 #define RX_FSM_PREDEF_HPP
 
 #include "rxcpp/rx.hpp"
+#include <atomic>
+#include <cstdint>
 #include <sstream>
 
 namespace rxcpp {
@@ -27,10 +29,17 @@ struct element_delegate
     std::string name;
     std::weak_ptr<element_delegate> owner_;
 
+    // the outermost state machine, frozen when assembled, looked up through the owners until then, empty once the
+    // state machine is destroyed, e.g. for an element kept by a handle
+    std::shared_ptr<const state_machine_delegate> root() const;
+
     std::shared_ptr<const state_machine_delegate> state_machine() const;
 
     bool is_assembled() const;
 
+    // called while the state machine is assembled, i.e. before it may be used by several threads
+    void freeze_root(const std::shared_ptr<const state_machine_delegate>& sm);
+
     template<class Delegate>
     std::shared_ptr<Delegate> owner() const
     {
@@ -65,13 +74,17 @@ struct element_delegate
 
     explicit element_delegate(std::string n);
 
-    element_delegate() = default;
+    element_delegate();
 
     virtual ~element_delegate() = default;
 
 private:
 
     std::string exception_prefix() const;
+
+    // written once, before assembled_ is set, and never after
+    std::weak_ptr<const state_machine_delegate> root_;
+    std::atomic<bool> assembled_;
 };
 
 }
@@ -222,6 +235,12 @@ struct empty_guard<void>
     bool operator()() const { return true; }
 };
 
+// pins the calling thread to a core (modulo the number of cores), does nothing where not supported
+void pin_current_thread(std::size_t core);
+
+// the core the calling thread runs on, where supported, otherwise a number per thread
+std::size_t current_core();
+
 }
 
 /*!  \brief  Trait for determining if type \a T is a state.
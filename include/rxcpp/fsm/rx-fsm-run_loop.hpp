@@ -0,0 +1,361 @@
+/*! \file  rx-fsm-run_loop.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_RUN_LOOP_HPP)
+#define RX_FSM_RUN_LOOP_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+typedef rxsc::scheduler_base::clock_type run_loop_clock;
+
+struct run_loop_item
+{
+    run_loop_clock::time_point when;
+    // orders the timers due at the same time by posting
+    std::uint64_t order;
+    rxsc::schedulable what;
+};
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// idle policy of a run loop parking as soon as there is nothing to execute
+struct park_when_idle
+{
+    template<class Loop>
+    bool operator()(const Loop&)
+    {
+        return true;
+    }
+};
+
+// idle policy of a run loop polling for posts for a budget of time before parking
+struct spin_then_park
+{
+    std::chrono::nanoseconds spin_budget;
+    std::atomic<std::int64_t> spinning;
+
+    explicit spin_then_park(std::chrono::nanoseconds budget)
+        : spin_budget(budget)
+        , spinning(0)
+    {
+    }
+
+    // returns true if the loop is still idle when the budget is exhausted, i.e. should park
+    template<class Loop>
+    bool operator()(const Loop& loop)
+    {
+        auto spin_start = run_loop_clock::now();
+        auto spin_end = spin_start + spin_budget;
+        auto now = spin_start;
+        for(; loop.idle(now) && now < spin_end && !loop.stop.load(); now = run_loop_clock::now())
+        {
+            cpu_relax();
+        }
+        spinning.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - spin_start).count(), std::memory_order_relaxed);
+        return loop.idle(now) && !loop.stop.load();
+    }
+};
+
+/*  Event loop executing the actions posted to it on one thread, the thread calling loop(), in the order they are due.
+
+    Posts of the loop's own thread are queued without synchronization, posts of other threads go through a locked
+    inbox, polled through a flag. What the loop does when there is nothing to execute is up to the Idle policy, after
+    which it parks on a condition variable until a post or the next timer.
+
+    Derived may hide the hooks below to add sources of posts of its own, e.g. single producer single consumer rings.
+ */
+template<class Derived, class Idle>
+struct run_loop
+{
+    struct later
+    {
+        bool operator()(const run_loop_item& lhs, const run_loop_item& rhs) const
+        {
+            return lhs.when > rhs.when || (lhs.when == rhs.when && lhs.order > rhs.order);
+        }
+    };
+
+    Idle idle_policy;
+
+    // posts of the loop's own thread
+    std::deque<run_loop_item> local;
+    // posts of other threads
+    std::mutex inbox_lock;
+    std::deque<run_loop_item> inbox;
+    std::atomic<bool> inbox_empty;
+    std::priority_queue<run_loop_item, std::vector<run_loop_item>, later> timers;
+    std::uint64_t timer_order;
+
+    std::mutex park_lock;
+    std::condition_variable wake;
+    std::atomic<bool> parked;
+    std::atomic<bool> stop;
+
+    std::atomic<std::uint64_t> executed, parks;
+    std::atomic<std::int64_t> working, parked_time;
+
+    template<class... IdleArgs>
+    explicit run_loop(IdleArgs&&... idle_args)
+        : idle_policy(std::forward<IdleArgs>(idle_args)...)
+        , inbox_empty(true)
+        , timer_order(0)
+        , parked(false)
+        , stop(false)
+        , executed(0)
+        , parks(0)
+        , working(0)
+        , parked_time(0)
+    {
+    }
+
+    // hooks, called on the loop's thread
+
+    // before collecting the posts
+    void flush_posts()
+    {
+    }
+
+    template<class F>
+    void drain_posts(F&&)
+    {
+    }
+
+    bool has_posts() const
+    {
+        return false;
+    }
+
+    // when to look for posts again while parked, even if not woken
+    run_loop_clock::time_point retry_at() const
+    {
+        return run_loop_clock::time_point::max();
+    }
+
+    // after the loop stopped
+    void discard_posts()
+    {
+    }
+
+    // to be called on the loop's thread only
+    void post_local(run_loop_item&& item)
+    {
+        local.push_back(std::move(item));
+    }
+
+    void post_inbox(run_loop_item&& item)
+    {
+        {
+            std::lock_guard<std::mutex> guard(inbox_lock);
+            inbox.push_back(std::move(item));
+            inbox_empty.store(false);
+        }
+        notify();
+    }
+
+    void notify()
+    {
+        if (parked.load()) {
+            std::lock_guard<std::mutex> guard(park_lock);
+            wake.notify_one();
+        }
+    }
+
+    bool idle(run_loop_clock::time_point now) const
+    {
+        return local.empty() && inbox_empty.load() && !derived().has_posts() &&
+            (timers.empty() || timers.top().when > now);
+    }
+
+    void collect(std::deque<run_loop_item>& ready, run_loop_clock::time_point now)
+    {
+        auto sort = [this, &ready, now](run_loop_item&& item) {
+            if (item.when <= now) {
+                ready.push_back(std::move(item));
+            } else {
+                item.order = timer_order++;
+                timers.push(std::move(item));
+            }
+        };
+        while (!local.empty())
+        {
+            sort(std::move(local.front()));
+            local.pop_front();
+        }
+        derived().drain_posts(sort);
+        if (!inbox_empty.load()) {
+            std::deque<run_loop_item> items;
+            {
+                std::lock_guard<std::mutex> guard(inbox_lock);
+                items.swap(inbox);
+                inbox_empty.store(true);
+            }
+            for(auto& item : items)
+            {
+                sort(std::move(item));
+            }
+        }
+        while (!timers.empty() && timers.top().when <= now)
+        {
+            ready.push_back(timers.top());
+            timers.pop();
+        }
+    }
+
+    void park()
+    {
+        std::unique_lock<std::mutex> guard(park_lock);
+        parked.store(true);
+        if (!stop.load() && inbox_empty.load() && !derived().has_posts()) {
+            parks.fetch_add(1, std::memory_order_relaxed);
+            auto park_start = run_loop_clock::now();
+            auto until = derived().retry_at();
+            if (!timers.empty()) {
+                until = std::min(until, timers.top().when);
+            }
+            if (until == run_loop_clock::time_point::max()) {
+                wake.wait(guard);
+            } else {
+                wake.wait_until(guard, until);
+            }
+            parked_time.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(run_loop_clock::now() - park_start).count(), std::memory_order_relaxed);
+        }
+        parked.store(false);
+    }
+
+    void loop()
+    {
+        rxsc::recursion r;
+        r.reset(false);
+        std::deque<run_loop_item> ready;
+        while (!stop.load())
+        {
+            derived().flush_posts();
+            auto now = run_loop_clock::now();
+            collect(ready, now);
+            if (!ready.empty()) {
+                while (!ready.empty())
+                {
+                    auto item = std::move(ready.front());
+                    ready.pop_front();
+                    if (item.what.is_subscribed()) {
+                        executed.fetch_add(1, std::memory_order_relaxed);
+                        item.what(r.get_recurse());
+                    }
+                }
+                working.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(run_loop_clock::now() - now).count(), std::memory_order_relaxed);
+                continue;
+            }
+            if (idle_policy(derived())) {
+                park();
+            }
+        }
+        // drop what is left, while on the loop's thread
+        local.clear();
+        derived().discard_posts();
+        while (!timers.empty())
+        {
+            timers.pop();
+        }
+    }
+
+    void shutdown()
+    {
+        stop.store(true);
+        std::lock_guard<std::mutex> guard(park_lock);
+        wake.notify_one();
+    }
+
+private:
+
+    Derived& derived()
+    {
+        return static_cast<Derived&>(*this);
+    }
+
+    const Derived& derived() const
+    {
+        return static_cast<const Derived&>(*this);
+    }
+};
+
+// worker posting to a run loop State, i.e. executing on its thread
+template<class State>
+struct run_loop_worker : public rxsc::worker_interface
+{
+    std::shared_ptr<State> state;
+
+    explicit run_loop_worker(std::shared_ptr<State> s)
+        : state(std::move(s))
+    {
+    }
+
+    virtual run_loop_clock::time_point now() const override
+    {
+        return run_loop_clock::now();
+    }
+
+    virtual void schedule(const rxsc::schedulable& scbl) const override
+    {
+        if (scbl.is_subscribed()) {
+            state->post(run_loop_clock::now(), scbl);
+        }
+    }
+
+    virtual void schedule(run_loop_clock::time_point when, const rxsc::schedulable& scbl) const override
+    {
+        if (scbl.is_subscribed()) {
+            state->post(when, scbl);
+        }
+    }
+};
+
+template<class State>
+struct run_loop_scheduler : public rxsc::scheduler_interface
+{
+    std::shared_ptr<State> state;
+
+    explicit run_loop_scheduler(std::shared_ptr<State> s)
+        : state(std::move(s))
+    {
+    }
+
+    virtual run_loop_clock::time_point now() const override
+    {
+        return run_loop_clock::now();
+    }
+
+    virtual rxsc::worker create_worker(composite_subscription cs) const override
+    {
+        return rxsc::worker(cs, std::make_shared<run_loop_worker<State>>(state));
+    }
+};
+
+}
+}
+}
+
+#endif
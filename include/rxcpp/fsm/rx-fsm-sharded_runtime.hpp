@@ -0,0 +1,160 @@
+/*! \file  rx-fsm-sharded_runtime.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_SHARDED_RUNTIME_HPP)
+#define RX_FSM_SHARDED_RUNTIME_HPP
+
+#include <cstdint>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Run time statistics of one shard of a \a sharded_runtime.
+ */
+struct shard_stats
+{
+    /*!  Number of actions executed by the shard.
+     */
+    std::uint64_t executed;
+
+    /*!  Number of actions posted by the shard's own thread.
+     */
+    std::uint64_t local_posts;
+
+    /*!  Number of actions posted by other shards through the single producer single consumer rings.
+     */
+    std::uint64_t ring_posts;
+
+    /*!  Number of actions posted by threads not belonging to the runtime, or by other shards when a ring was full.
+     */
+    std::uint64_t inbox_posts;
+};
+
+/*!  \brief  One shard of a \a sharded_runtime, usable as coordination when starting a state machine.
+
+     All workers created from the shard execute on the shard's single event loop thread, i.e. a state machine
+     started on a shard is serialized without further synchronization.
+ */
+class shard final : public identity_one_worker
+{
+public:
+
+    typedef shard this_type;
+
+private:
+
+    std::size_t index_;
+
+public:
+
+    shard(rxsc::scheduler sc, std::size_t index);
+
+    /*!  \return  The index of the shard in the runtime.
+     */
+    std::size_t index() const
+    {
+        return index_;
+    }
+};
+
+namespace detail {
+
+struct sharded_runtime_delegate;
+
+}
+
+/*!  \brief  Thread per core runtime of state machines.
+
+     The runtime runs one event loop thread per shard, each pinned to its own core (on Linux). State machine instances
+     are hashed to shards by a key, e.g. their name, and started with the \a shard as coordination. A shard allocates its
+     queues, including the rings other shards post to it through, on its own thread at startup, and the state of its
+     state machines is allocated there as they are entered, so memory is placed on the shard's NUMA node by first touch.
+     Actions posted from one shard to another go through a single producer single consumer ring per pair of shards, so
+     shards never contend on a shared queue.
+
+     \note  The class uses reference semantics.
+ */
+class sharded_runtime final
+{
+public:
+
+    typedef sharded_runtime this_type;
+    typedef detail::sharded_runtime_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit sharded_runtime(std::shared_ptr<delegate_type> d);
+
+    friend sharded_runtime make_sharded_runtime(std::size_t shards, bool pin);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \return  The number of shards.
+     */
+    std::size_t size() const;
+
+    /*!  \brief  Returns a shard by index.
+
+         \param index  The index of the shard, must be less than \a size.
+
+         \return  The shard.
+     */
+    shard get_shard(std::size_t index) const;
+
+    /*!  \brief  Returns the shard a key is hashed to.
+
+         \param key  The key, e.g. the name of a state machine.
+
+         \return  The shard.
+     */
+    shard shard_for(const std::string& key) const;
+
+    /*!  \brief  Returns the shard a key is hashed to.
+
+         \param key  The key, e.g. the identity of a state machine instance.
+
+         \return  The shard.
+     */
+    shard shard_for(std::uint64_t key) const;
+
+    /*!  \brief  Returns the run time statistics of a shard.
+
+         \param index  The index of the shard, must be less than \a size.
+
+         \return  The statistics.
+     */
+    shard_stats stats(std::size_t index) const;
+};
+
+/*!  \brief Creates a sharded runtime.
+
+     \param shards  Number of shards, zero means one per hardware thread.
+     \param pin     If true, the thread of shard i is pinned to core i modulo the number of cores.
+
+     \return  A \a sharded_runtime instance.
+ */
+sharded_runtime make_sharded_runtime(std::size_t shards = 0, bool pin = true);
+
+}
+}
+
+#endif
@@ -9,12 +9,22 @@
 #if !defined(RX_FSM_STATE_MACHINE_HPP)
 #define RX_FSM_STATE_MACHINE_HPP
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <unordered_map>
 
+#include "rx-fsm-broadcast.hpp"
 #include "rx-fsm-delegates.hpp"
+#include "rx-fsm-event.hpp"
+#include "rx-fsm-flat_combining.hpp"
+#include "rx-fsm-pool.hpp"
 #include "rx-fsm-pseudostate.hpp"
 #include "rx-fsm-state.hpp"
+#include "rx-fsm-metrics.hpp"
+#include "rx-fsm-tracer.hpp"
 #include "rx-fsm-transition.hpp"
+#include "rx-fsm-virtual_time.hpp"
 
 namespace rxcpp {
 
@@ -32,40 +42,222 @@ struct state_machine_delegate : public virtual_region_delegate
     {
         active,
         await_join,
-        await_finalize
+        await_finalize,
+        region_status_count
     };
 
-    // "static" data
-    typedef std::unordered_map<std::shared_ptr<virtual_vertex_delegate>, std::vector<std::shared_ptr<state_delegate>>> state_ancestor_map;
-    state_ancestor_map state_ancestors;
-    typedef std::unordered_map<std::shared_ptr<virtual_vertex_delegate>, observable<transition_delegate::transition_data>> state_observable_map;
-    state_observable_map state_observable;
+    // "static" data, frozen when assembled
+    // one record per vertex, indexed by vertex id, i.e. in depth first order. The ancestors of all vertices are
+    // stored in one contiguous table and the owning region is a raw pointer, the definition cannot change anymore
+    typedef std::vector<std::shared_ptr<state_delegate>> ancestor_table;
+    typedef observable<transition_delegate::transition_data> vertex_observable;
+    struct frozen_vertex
+    {
+        virtual_region_delegate* region;
+        std::uint32_t ancestors_begin;
+        std::uint32_t ancestors_end;
+        vertex_observable transitions;
+    };
+    std::vector<frozen_vertex> frozen;
+    ancestor_table ancestors;
     typedef std::unordered_map<std::shared_ptr<pseudostate_delegate>, std::vector<std::shared_ptr<virtual_vertex_delegate>>> join_pseudostate_map;
     join_pseudostate_map join_pseudostates;
     std::unordered_set<std::shared_ptr<virtual_vertex_delegate>> target_states;
+    std::vector<std::shared_ptr<virtual_vertex_delegate>> vertices;
+    std::vector<std::shared_ptr<transition_delegate>> transitions_table;
     std::atomic_bool assembled;
 
     // "dynamic" data
     struct current_state
     {
-        std::weak_ptr<virtual_region_delegate> region;
+        virtual_region_delegate* region;
         std::shared_ptr<virtual_vertex_delegate> state;
         region_status_type status;
         composite_subscription lifetime, state_lifetime;
         std::weak_ptr<current_state> parent;
         std::vector<std::shared_ptr<current_state>> children;
+        // number of children per status, i.e. the pending orthogonal regions of the state
+        std::size_t regions[region_status_count];
         bool entered;
     };
-    typedef std::unordered_map<std::shared_ptr<pseudostate_delegate>, std::shared_ptr<virtual_vertex_delegate>> shallow_history_pseudostate_map;
-    shallow_history_pseudostate_map shallow_history_pseudostates;
-    typedef std::unordered_map<std::shared_ptr<pseudostate_delegate>, std::vector<std::shared_ptr<virtual_vertex_delegate>>> deep_history_pseudostate_map;
-    deep_history_pseudostate_map deep_history_pseudostates;
+    // last active state(s) of a region owning a history pseudostate, as vertex ids stored inline unless wide
+    struct history_record
+    {
+        static const std::size_t inline_capacity = 4;
+
+        std::shared_ptr<pseudostate_delegate> pseudostate;
+        std::size_t size;
+        std::uint32_t inline_ids[inline_capacity];
+        std::vector<std::uint32_t> spilled;
+
+        void clear()
+        {
+            size = 0;
+            spilled.clear();
+        }
+
+        void push_back(std::uint32_t id)
+        {
+            if (size < inline_capacity) {
+                inline_ids[size] = id;
+            } else {
+                spilled.push_back(id);
+            }
+            ++size;
+        }
+
+        std::uint32_t operator[](std::size_t i) const
+        {
+            return i < inline_capacity ? inline_ids[i] : spilled[i - inline_capacity];
+        }
+    };
+    std::vector<history_record> histories;
+    std::shared_ptr<node_pool> pool;
     std::shared_ptr<current_state> current;
     composite_subscription subject_lifetime;
     subjects::subject<transition> subject;
 
+    // events
+    typedef std::unordered_map<event_id, std::shared_ptr<event_slot_base>> event_slot_map;
+    event_slot_map event_slots;
+    event_table events;
+    // set when the event table is built, publishes it to threads firing events
+    std::atomic<bool> events_ready;
+    std::shared_ptr<broadcast_dispatcher_delegate> broadcast;
+
+    template<class T>
+    observable<T> on_event(const event_id& id)
+    {
+        auto it = event_slots.find(id);
+        if (it == event_slots.end()) {
+            auto slot = std::make_shared<event_slot<T>>(id);
+            event_slots[id] = slot;
+            return slot->get_observable();
+        }
+        if (it->second->type != typeid(T)) {
+            std::ostringstream msg;
+            msg << "has already declared event '" << id.name() << "' with another payload type";
+            throw_exception<not_allowed>(msg.str());
+        }
+        return std::static_pointer_cast<event_slot<T>>(it->second)->get_observable();
+    }
+
+    template<class T>
+    bool fire(const event_id& id, const T& payload)
+    {
+        auto* slot = events.find(id);
+        if (!slot) {
+            RX_FSM_TRACE(trace_ignored(id));
+            return false;
+        }
+        if (slot->type != typeid(T)) {
+            std::ostringstream msg;
+            msg << "cannot fire event '" << id.name() << "' with another payload type than declared";
+            throw_exception<not_allowed>(msg.str());
+        }
+        auto& subject = static_cast<event_slot<T>*>(slot)->subject;
+        RX_FSM_TRACE(if (traced() && !subject.has_observers()) trace_ignored(id));
+        subject.get_subscriber().on_next(payload);
+        return true;
+    }
+
+    void build_event_table();
+
+    // virtual clock of the timeout transitions, if any
+    std::shared_ptr<virtual_time_delegate> clock;
+
+    // tracing, the trace points are compiled in only if RXCPP_FSM_TRACING is defined
+    std::vector<std::shared_ptr<tracer>> tracers;
+    std::shared_ptr<tracer> tracing;
+    std::shared_ptr<metrics_delegate> metering;
+    std::uint32_t trace_id;
+    // whether the current step is sampled, and the start of the last sampled entry of every vertex, 0 if not sampled,
+    // the sampling is also read by guards and fired events on the threads of their producers
+    std::atomic<bool> trace_step;
+    mutable std::vector<std::uint64_t> trace_entered;
+    // the number of the next step, counted by the thread executing the state machine only
+    std::uint64_t trace_steps;
+
+    bool traced() const
+    {
+        return trace_step.load(std::memory_order_relaxed) && tracing;
+    }
+
+    void add_tracer(std::shared_ptr<tracer> t);
+
+    void trace_assembled();
+
+    // decides whether the next step is sampled
+    void trace_next_step();
+
+    void trace_ignored(const event_id& id) const;
+
+    // executes the entry or exit action of a state, or the action of a transition
+    void enter_action(state_delegate& s) const;
+
+    void exit_action(state_delegate& s) const;
+
+    void execute(transition_delegate::action& a, std::uint32_t transition) const;
+
+    void execute(transition_delegate& t) const;
+
+    // parallel regions
+    bool parallel_regions;
+    rxsc::scheduler region_scheduler;
+    // created as needed and reused by every step, owned by the lifetime of the running state machine
+    std::vector<rxsc::worker> region_workers;
+
+    // user actions of orthogonal regions entered in the same step are recorded here and replayed concurrently
+    std::vector<std::function<void()>>* recorded_actions;
+
+    // records the actions of one region, restores the recording state of the thread when left
+    struct recording_scope
+    {
+        state_machine_delegate* machine;
+        const state_machine_delegate* outer;
+
+        recording_scope(state_machine_delegate* sm, std::vector<std::function<void()>>* actions);
+        ~recording_scope();
+    };
+
+    template<class F>
+    void perform(F f)
+    {
+        if (recorded_actions) {
+            recorded_actions->push_back(std::move(f));
+        } else {
+            f();
+        }
+    }
+
+    // only on the thread executing the step, guards may run on the threads of their triggers
+    void flush_recorded_actions() const;
+
+    void run_parallel(const std::vector<std::function<void()>>& actions);
+
+    ancestor_table::const_iterator ancestors_begin(const virtual_vertex_delegate& vertex) const
+    {
+        return ancestors.begin() + frozen[vertex.id].ancestors_begin;
+    }
+
+    ancestor_table::const_iterator ancestors_end(const virtual_vertex_delegate& vertex) const
+    {
+        return ancestors.begin() + frozen[vertex.id].ancestors_end;
+    }
+
+    virtual_region_delegate* region_of(const virtual_vertex_delegate& vertex) const
+    {
+        return frozen[vertex.id].region;
+    }
+
+    // owning handle of a vertex of the assembled state machine, without touching the reference count
+    const std::shared_ptr<virtual_vertex_delegate>& handle_of(const virtual_vertex_delegate& vertex) const
+    {
+        return vertices[vertex.id];
+    }
+
     template<class Coordination>
-    state_observable_map::mapped_type generate_observable_transitions(const Coordination& cn, const state_observable_map::key_type& state)
+    vertex_observable generate_observable_transitions(const Coordination& cn, const std::shared_ptr<virtual_vertex_delegate>& state)
     {
        auto& transitions = state->transitions;
        if (transitions.empty()) {
@@ -77,8 +269,8 @@ struct state_machine_delegate : public virtual_region_delegate
        {
            std::vector<std::shared_ptr<transition_delegate>> equally_triggered_transitions;
            equally_triggered_transitions.push_back(t);
-           auto& ancestors = state_ancestors[state];
-           for(auto it = ancestors.rbegin(); it != ancestors.rend(); ++it)
+           ancestor_table::const_reverse_iterator first(ancestors_end(*state)), last(ancestors_begin(*state));
+           for(auto it = first; it != last; ++it)
            {
                for(const auto& tt : (*it)->transitions)
                {
@@ -90,16 +282,33 @@ struct state_machine_delegate : public virtual_region_delegate
            }
            observables.push_back(t->make_observable(equally_triggered_transitions));
        }
-       return observable<>::iterate(observables, identity_immediate()).merge(identity_immediate()).observe_on(cn);
+       return dispatch_on(cn, observable<>::iterate(observables, identity_immediate()).merge(identity_immediate()));
     }
 
     void get_join_pseudostates(const std::shared_ptr<virtual_vertex_delegate>& state);
 
     template<class Coordination>
-    void generate_maps_recursively(const Coordination& cn, const state_ancestor_map::key_type& state, state_ancestor_map::mapped_type& ancestors)
+    void generate_maps_recursively(const Coordination& cn, const std::shared_ptr<virtual_vertex_delegate>& state, ancestor_table& state_ancestors)
     {
-        state_ancestors[state] = ancestors;
-        state_observable[state] = generate_observable_transitions(cn, state);
+        state->id = static_cast<std::uint32_t>(vertices.size());
+        vertices.push_back(state);
+        // freeze the root of every element, i.e. dispatching never walks the owners
+        auto self = this->shared_from_this();
+        state->freeze_root(self);
+        for(const auto& t : state->transitions)
+        {
+            t->freeze_root(self);
+            t->freeze();
+            t->id = static_cast<std::uint32_t>(transitions_table.size());
+            transitions_table.push_back(t);
+        }
+        frozen_vertex f;
+        f.region = state->owner<virtual_region_delegate>().get();
+        f.ancestors_begin = static_cast<std::uint32_t>(ancestors.size());
+        ancestors.insert(ancestors.end(), state_ancestors.begin(), state_ancestors.end());
+        f.ancestors_end = static_cast<std::uint32_t>(ancestors.size());
+        frozen.push_back(f);
+        frozen.back().transitions = generate_observable_transitions(cn, state);
         for(const auto& t : state->transitions)
         {
             auto tgt = t->target();
@@ -110,10 +319,20 @@ struct state_machine_delegate : public virtual_region_delegate
         get_join_pseudostates(state);
         auto s = std::dynamic_pointer_cast<state_delegate>(state);
         if (s) {
-            state_ancestor_map::mapped_type sub_state_ancestors = ancestors;
+            ancestor_table sub_state_ancestors = state_ancestors;
             sub_state_ancestors.push_back(s);
             for(const auto& region : s->regions)
             {
+                region->freeze_root(self);
+                generate_history(region);
+                auto sub_machine = std::dynamic_pointer_cast<state_machine_delegate>(region);
+                if (sub_machine) {
+                    // events declared through a sub machine are dispatched by the dispatcher of the root
+                    if (!sub_machine->broadcast) {
+                        sub_machine->broadcast = broadcast;
+                    }
+                    sub_machine->build_event_table();
+                }
                 for(const auto& sub_state : region->sub_states)
                 {
                     generate_maps_recursively(cn, sub_state, sub_state_ancestors);
@@ -125,10 +344,16 @@ struct state_machine_delegate : public virtual_region_delegate
     template<class Coordination>
     void generate_maps(const Coordination& cn)
     {
+        vertices.clear();
+        frozen.clear();
+        ancestors.clear();
+        histories.clear();
+        freeze_root(this->shared_from_this());
+        generate_history(this->shared_from_this());
         for(const auto& state : sub_states)
         {
-            state_ancestor_map::mapped_type ancestors;
-            generate_maps_recursively(cn, state, ancestors);
+            ancestor_table state_ancestors;
+            generate_maps_recursively(cn, state, state_ancestors);
         }
     }
 
@@ -138,29 +363,45 @@ struct state_machine_delegate : public virtual_region_delegate
 
     std::multimap<int, const std::shared_ptr<current_state>> determine_exit_order(const std::shared_ptr<current_state>& current);
 
-    void get_deep_history_recursively(const std::shared_ptr<current_state>& current, std::vector<std::shared_ptr<virtual_vertex_delegate>>& history);
+    std::size_t add_history(const std::shared_ptr<pseudostate_delegate>& pseudostate);
+
+    void generate_history(const std::shared_ptr<virtual_region_delegate>& region);
+
+    history_record* find_history(const std::shared_ptr<pseudostate_delegate>& pseudostate);
 
-    std::vector<std::shared_ptr<virtual_vertex_delegate>> get_deep_history(const std::shared_ptr<current_state>& current);
+    void record_deep_history(const std::shared_ptr<current_state>& current, history_record& history);
+
+    std::shared_ptr<current_state> make_current_state();
 
     void exit_region(const std::shared_ptr<current_state>& current);
 
+    void add_region(const std::shared_ptr<current_state>& parent, const std::shared_ptr<current_state>& current);
+
+    void set_region_status(const std::shared_ptr<current_state>& current, region_status_type status);
+
+    void exit_state_actions(const std::shared_ptr<current_state>& current);
+
+    void release_state(const std::shared_ptr<current_state>& common, const std::shared_ptr<current_state>& current);
+
     void exit_state(const std::shared_ptr<current_state>& common, const std::shared_ptr<current_state>& current);
 
     void exit_states_recursively(const std::shared_ptr<current_state>& current);
 
     std::vector<std::shared_ptr<virtual_vertex_delegate>> determine_target_states(const std::shared_ptr<virtual_vertex_delegate>& target);
 
-    void state_transition(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& target, const std::shared_ptr<transition_delegate::action>& action);
+    void state_transition(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& target, const std::shared_ptr<transition_delegate::action>& action, std::uint32_t transition);
 
-    std::shared_ptr<current_state> find_current_state(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& source_state) const;
+    std::shared_ptr<current_state> find_current_state(const std::shared_ptr<current_state>& current, const virtual_vertex_delegate* source_state) const;
 
-    std::shared_ptr<current_state> find_current_region(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_region_delegate>& source_region) const;
+    std::shared_ptr<current_state> find_current_region(const std::shared_ptr<current_state>& current, const virtual_region_delegate* source_region) const;
 
     void enter_state(const std::shared_ptr<current_state>& current);
 
+    bool enter_and_adopt(const std::shared_ptr<current_state>& current);
+
     void enter_states_recursively(const std::shared_ptr<current_state>& current, const std::vector<std::shared_ptr<virtual_vertex_delegate>>& target_states);
 
-    void guard_executed(const std::shared_ptr<virtual_vertex_delegate>& state) const;
+    void guard_executed(virtual_vertex_delegate* state) const;
 
     void validate();
 
@@ -182,20 +423,26 @@ struct state_machine_delegate : public virtual_region_delegate
                 self->throw_exception<not_allowed>("must have states");
             }
             self->generate_maps(cn);
+            RX_FSM_TRACE(self->trace_assembled());
+            self->build_event_table();
             self->validate();
             auto initial = get_pseudostate(pseudostate_kind::initial, self->sub_states);
             if (!initial) {
                 self->throw_exception<not_allowed>("has no initial state");
             }
-            self->current = std::make_shared<current_state>();
-            self->current->lifetime.add(self->subject_lifetime);
-            self->current->region = self;
-            self->current->status = active;
-            std::vector<std::shared_ptr<virtual_vertex_delegate>> states(1, initial);
-            auto cs = self->subject.get_observable().subscribe(subscr);
-            self->current->lifetime.add(cs);
-            self->current->entered = false;
-            self->enter_states_recursively(self->current, states);
+            auto start_up = [self, initial, subscr]() {
+                self->current = self->make_current_state();
+                self->current->lifetime.add(self->subject_lifetime);
+                self->current->region = self.get();
+                self->current->status = active;
+                std::fill(std::begin(self->current->regions), std::end(self->current->regions), 0);
+                std::vector<std::shared_ptr<virtual_vertex_delegate>> states(1, initial);
+                auto cs = self->subject.get_observable().subscribe(subscr);
+                self->current->lifetime.add(cs);
+                self->current->entered = false;
+                self->enter_states_recursively(self->current, states);
+            };
+            run_on(cn, start_up);
         }).subscribe_on(cn);
     }
 
@@ -280,6 +527,155 @@ public:
      */
     std::vector<std::string> find_unreachable_states() const;
 
+    /*!  \brief  Declares an event, identified by \a id, and returns an observable of its occurrences.
+
+         The observable can be used as trigger of any triggered transition of the state machine. When the state machine
+         is assembled, a minimal perfect hash is generated over all declared events, so that \a fire resolves an event
+         identifier to its subscribers in a single probe.
+
+         \tparam T  The payload type of the event. Defaults to \a event_id, i.e. the identifier itself is the payload.
+
+         \param id  The event identifier.
+
+         \return  An observable of the payloads fired with identifier \a id.
+     */
+    template<class T = event_id>
+    observable<T> on_event(const event_id& id)
+    {
+        if (delegate->is_assembled()) {
+            delegate->throw_exception<not_allowed>("state machine already assembled");
+        }
+        return delegate->on_event<T>(id);
+    }
+
+    /*!  \brief  Attaches the state machine to a broadcast dispatcher.
+
+         Events declared by \a on_event may then also be fired through the dispatcher, which only delivers them to
+         the attached state machines whose active states currently have transitions triggered by the event.
+
+         \param dispatcher  The broadcast dispatcher.
+
+         \return  A reference to self
+     */
+    this_type& with_broadcast_dispatcher(const broadcast_dispatcher& dispatcher);
+
+    /*!  \brief  Executes the entry and exit actions of orthogonal regions concurrently.
+
+         When several orthogonal regions are entered or exited in the same run-to-completion step, e.g. when an
+         orthogonal state is entered or a fork fans out, the entry (or exit) actions of the states on the same
+         nesting level are executed concurrently on workers of \a sc, and the step continues when all of them have
+         completed. Nesting levels are still entered outside in and exited inside out. The bookkeeping of the state
+         machine, as well as transition actions and guards, remain on the coordination of the state machine.
+         The workers are created once, as many as the most regions executed concurrently, and are released when
+         the state machine terminates.
+
+         \note  Entry and exit actions of orthogonal regions must then be thread safe with respect to each other.
+
+         \param sc  The scheduler to execute the actions on, e.g. an event loop.
+
+         \return  A reference to self
+     */
+    this_type& with_parallel_regions(rxsc::scheduler sc);
+
+    /*!  \brief  Runs the timeout transitions of the state machine, including those of its sub machines, on a virtual clock.
+
+         \note  Timeout transitions then expire when the clock is advanced, regardless of the coordination they were
+                defined with.
+
+         \param vt  The virtual clock.
+
+         \return  A reference to self
+     */
+    this_type& with_virtual_time(const virtual_time& vt);
+
+    /*!  \brief  Attaches a tracer, receiving the trace points of the state machine and its sub machines.
+
+         Several tracers may be attached, each sampling the steps of the state machine on its own.
+
+         \note  The trace points are only invoked if the library is built with RXCPP_FSM_TRACING defined, otherwise
+                they are compiled out and the tracer is never called.
+
+         \param t  The tracer.
+
+         \return  A reference to self
+     */
+    this_type& with_tracer(std::shared_ptr<tracer> t);
+
+    /*!  \brief  Collects metrics of the state machine, see \a metrics.
+
+         \note  Metrics are collected by the trace points, i.e. the library must be built with RXCPP_FSM_TRACING
+                defined.
+
+         \return  A reference to self
+
+         \throw  not_allowed if the state machine is already assembled, or the trace points are compiled out.
+     */
+    this_type& with_metrics();
+
+    /*!  \brief  Returns the metrics collected since the state machine was started, merged from all threads.
+
+         \return  A snapshot of the metrics, with the vertices and transitions named by their hierarchical names.
+     */
+    fsm::metrics metrics() const;
+
+    /*!  \brief  Fires an event declared by \a on_event.
+
+         \note State machine must be assembled.
+
+         \tparam T  The payload type, must be the same as the one the event was declared with.
+
+         \param id       The event identifier.
+         \param payload  The event payload.
+
+         \return  True if the event is declared by the state machine, otherwise false.
+     */
+    template<class T>
+    bool fire(const event_id& id, const T& payload)
+    {
+        if (!delegate->events_ready.load(std::memory_order_acquire)) {
+            delegate->throw_exception<not_allowed>("must be assembled");
+        }
+        return delegate->fire<typename std::decay<T>::type>(id, payload);
+    }
+
+    /*!  \brief  Fires an event declared by \a on_event with a \c std::string payload, e.g. with a string literal.
+
+         \note State machine must be assembled.
+
+         \param id       The event identifier.
+         \param payload  The event payload.
+
+         \return  True if the event is declared by the state machine, otherwise false.
+     */
+    bool fire(const event_id& id, const char* payload)
+    {
+        return fire(id, std::string(payload));
+    }
+
+    /*!  \brief  Fires an event declared by \a on_event without payload, i.e. with the identifier as payload.
+
+         \note State machine must be assembled.
+
+         \param id  The event identifier.
+
+         \return  True if the event is declared by the state machine, otherwise false.
+     */
+    bool fire(const event_id& id);
+
+    /*!  \brief  Size information of the event table generated at assemble time, e.g. for memory budgeting.
+
+         \note State machine must be assembled.
+
+         \return  The event table statistics.
+     */
+    event_table_stats event_stats() const;
+
+    /*!  \brief  Allocation information of the pool that recycles the nodes of the active state configuration.
+
+         \return  The pool statistics.
+     */
+    node_pool_stats pool_stats() const;
+
     /*!  \brief  Assembles the state machine, using a specified coordination as event receiver.
 
          After the state machine has been defined (i.e. states and transitions are added), it must be assembled.
@@ -288,6 +684,8 @@ public:
          this function. When this observable is subscribed the state machine is started.
          All actions (including start up) will be executed on the supplied coordination \a cn. To avoid thread safety
          issues, you may very well use a thread safe single worker coordination, e.g. serialize_same_worker.
+         Alternatively, \a flat_combining may be used, which executes the actions on the producing threads but never
+         concurrently, avoiding the queue of a single worker when many threads fire events into the machine.
 
          \tparam Coordination  The coordination type of actions.
 
@@ -0,0 +1,185 @@
+/*! \file  rx-fsm-tracer.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_TRACER_HPP)
+#define RX_FSM_TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*  Trace points are only compiled in when RXCPP_FSM_TRACING is defined (see the CMake option of the same name),
+    otherwise they expand to nothing, i.e. a state machine without tracing has no trace overhead at all.
+ */
+#if defined(RXCPP_FSM_TRACING)
+#define RX_FSM_TRACE(expr) expr
+#else
+#define RX_FSM_TRACE(expr) ((void)0)
+#endif
+
+/*  USDT probes, e.g. for bpftrace or perf, are only compiled in when RXCPP_FSM_USDT is defined (see the CMake option
+    of the same name), which requires sys/sdt.h to build the library, but not to use it. The probes of the provider
+    rxcpp_fsm are a single nop each until attached, and their arguments are only evaluated while a probe is attached,
+    see RX_FSM_PROBE_ENABLED. The first two arguments of every probe are the trace id and the name of the state machine:
+        state_enter(machine, name, vertex id, vertex name)
+        state_exit(machine, name, vertex id, vertex name)
+        transition(machine, name, transition id, transition name, source vertex id, target vertex id)
+        guard(machine, name, transition id, transition name, passed)
+        history(machine, name, pseudostate id, pseudostate name, number of states restored)
+        fork(machine, name, pseudostate id, pseudostate name, number of outgoing transitions)
+ */
+#if defined(RXCPP_FSM_USDT)
+#define RX_FSM_PROBE_ENABLED(name) (rxcpp_fsm_##name##_semaphore != 0)
+extern "C" {
+extern volatile unsigned short rxcpp_fsm_state_enter_semaphore;
+extern volatile unsigned short rxcpp_fsm_state_exit_semaphore;
+extern volatile unsigned short rxcpp_fsm_transition_semaphore;
+extern volatile unsigned short rxcpp_fsm_guard_semaphore;
+extern volatile unsigned short rxcpp_fsm_history_semaphore;
+extern volatile unsigned short rxcpp_fsm_fork_semaphore;
+}
+#else
+#define RX_FSM_PROBE_ENABLED(name) false
+#endif
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Receiver of the trace points of a state machine.
+
+     A tracer is attached to a state machine with \a state_machine::with_tracer, and is invoked on the thread executing
+     the state machine, except \a guard_evaluated, \a event_unhandled and \a event_ignored, which are invoked on the
+     threads emitting the triggers and firing the events, i.e. possibly concurrently with each other and with the other
+     trace points of the same state machine. Likewise, with \a state_machine::with_parallel_regions, \a state_entered,
+     \a state_exited and \a action_executed are invoked on the region workers, concurrently for the orthogonal regions
+     of a step. Vertices and transitions are identified by their index in the tables passed to \a assembled, and times
+     are nanoseconds of the steady clock (see \a now). All functions do nothing by default, so a tracer only overrides
+     the trace points it is interested in.
+
+     Tracing is sampled per run to completion step of a machine, see \a sample, the trace points of an unsampled step
+     are skipped without taking any time. The concurrent trace points follow the sampling decision last made, i.e.
+     they are traced along with the step that follows, or with the step executing meanwhile.
+
+     \note  The trace points are only invoked if the library is built with RXCPP_FSM_TRACING defined.
+ */
+class tracer
+{
+public:
+
+    /*!  \return  The current time in nanoseconds of the steady clock.
+     */
+    static std::uint64_t now();
+
+    /*!  \brief  A state machine was assembled.
+
+         \param machine      The process unique id of the state machine, passed to all other trace points.
+         \param name         The name of the state machine.
+         \param vertices     The hierarchical names of all vertices, separated by '/', indexed by vertex id.
+         \param transitions  The hierarchical names of all transitions, indexed by transition id.
+     */
+    virtual void assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions);
+
+    /*!  \brief  Decides whether the next run to completion step of a state machine is traced.
+
+         Called once the state machine is assembled, and after every step. Guards are evaluated before their step,
+         i.e. they are traced along with the step that follows.
+
+         \param step  The number of the step, counted per state machine from 0.
+
+         \return  True if the step is traced, by default all steps are.
+     */
+    virtual bool sample(std::uint32_t machine, std::uint64_t step);
+
+    /*!  \brief  The guard of a transition was evaluated.
+     */
+    virtual void guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed);
+
+    /*!  \brief  The action of a transition was executed.
+     */
+    virtual void action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition);
+
+    /*!  \brief  A state was entered, the time span covers its entry action.
+     */
+    virtual void state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state);
+
+    /*!  \brief  A state was exited, the time span covers its exit action.
+
+         \param entered  The start of the traced entry of the state, or 0 if the state was entered in an unsampled step.
+     */
+    virtual void state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered);
+
+    /*!  \brief  A history pseudostate restored a number of previously active states.
+     */
+    virtual void history_restored(std::uint32_t machine, std::uint64_t time, std::uint32_t history, std::size_t states);
+
+    /*!  \brief  An orthogonal region reached a join pseudostate or final state.
+
+         \param vertex     The join pseudostate or final state.
+         \param completed  True if all orthogonal regions are now joined or finalized.
+     */
+    virtual void region_completed(std::uint32_t machine, std::uint64_t time, std::uint32_t vertex, bool completed);
+
+    /*!  \brief  An event was fired that the state machine does not declare, or that no active state has a transition for.
+
+         \param event  The value of the event identifier.
+     */
+    virtual void event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event);
+
+    /*!  \brief  A trigger of a state emitted, but the guards of all its transitions failed.
+     */
+    virtual void event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state);
+
+    virtual ~tracer() = default;
+};
+
+namespace detail {
+
+// next process unique state machine id of the trace points
+std::uint32_t next_trace_id();
+
+// forwards the trace points of a state machine to several tracers, each sampling steps on its own
+class tracer_list final : public tracer
+{
+    std::vector<std::shared_ptr<tracer>> tracers;
+    // written by sample on the thread executing the state machine, read by the concurrent trace points too
+    std::unique_ptr<std::atomic<bool>[]> sampled;
+
+public:
+
+    explicit tracer_list(std::vector<std::shared_ptr<tracer>> t);
+
+    virtual void assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions) override;
+
+    virtual bool sample(std::uint32_t machine, std::uint64_t step) override;
+
+    virtual void guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed) override;
+
+    virtual void action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition) override;
+
+    virtual void state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state) override;
+
+    virtual void state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered) override;
+
+    virtual void history_restored(std::uint32_t machine, std::uint64_t time, std::uint32_t history, std::size_t states) override;
+
+    virtual void region_completed(std::uint32_t machine, std::uint64_t time, std::uint32_t vertex, bool completed) override;
+
+    virtual void event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event) override;
+
+    virtual void event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state) override;
+};
+
+}
+
+}
+}
+
+#endif
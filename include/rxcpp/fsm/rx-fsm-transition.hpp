@@ -12,6 +12,7 @@
 #include <atomic>
 
 #include "rx-fsm-delegates.hpp"
+#include "rx-fsm-tracer.hpp"
 
 namespace rxcpp {
 
@@ -39,8 +40,16 @@ struct transition_delegate : public element_delegate
 
     std::atomic<bool> blocked;
 
+    // non-owning source and target, set when the state machine is assembled and valid as long as it lives
+    virtual_vertex_delegate* frozen_source;
+    virtual_vertex_delegate* frozen_target;
+    // index in the transition table of the state machine, set when it is assembled
+    std::uint32_t id;
+
     std::shared_ptr<virtual_vertex_delegate> target() const;
 
+    void freeze();
+
     virtual bool try_block() = 0;
     virtual void unblock() = 0;
     virtual bool equal_trigger(const std::shared_ptr<transition_delegate>& other) const = 0;
@@ -56,7 +65,8 @@ struct transition_delegate : public element_delegate
     typedef std::function<void()> void_action_t;
     typedef std::function<bool()> void_guard_t;
 
-    typedef std::tuple<std::shared_ptr<virtual_vertex_delegate>, std::shared_ptr<transition_delegate>, std::shared_ptr<action>> transition_data;
+    // source, transition and action of a triggered transition, the source and the transition are non-owning
+    typedef std::tuple<virtual_vertex_delegate*, transition_delegate*, std::shared_ptr<action>> transition_data;
 
     virtual observable<transition_data> make_observable(const std::vector<std::shared_ptr<transition_delegate>>& transitions) = 0;
 
@@ -64,6 +74,16 @@ struct transition_delegate : public element_delegate
 
     void guard_executed() const;
 
+    // start of a sampled guard evaluation, 0 if not sampled
+    std::uint64_t trace_start() const;
+
+    void trace_guard(std::uint64_t start, bool passed) const;
+
+    void trace_unhandled() const;
+
+    // fires the USDT probe of the guard, out of line since the probes are fired by the library only
+    void probe_guard(bool passed) const;
+
     explicit transition_delegate(bool g, const std::shared_ptr<virtual_vertex_delegate>& tgt, std::string n, const std::shared_ptr<virtual_vertex_delegate>& o, transition_t t);
 
     explicit transition_delegate(bool g, std::string n, const std::shared_ptr<virtual_vertex_delegate>& o, transition_t t);
@@ -144,20 +164,22 @@ struct triggered_transition_delegate : public transition_delegate
     typedef std::function<void(const value_type&)> action_t;
     typedef std::function<bool(const value_type&)> guard_t;
 
+    // refers to the action of the transition, which outlives the dispatch, but copies the value, i.e. every event that
+    // passes the guard still allocates an action and copies its payload once, which for a buffer only bumps its count
     struct typed_action : public action
     {
-        action_t action;
+        const action_t* action;
         value_type value;
 
-        explicit typed_action(action_t a, value_type v)
-        : action(std::move(a))
-        , value(std::move(v))
+        explicit typed_action(const action_t& a, const value_type& v)
+        : action(&a)
+        , value(v)
         {
         }
 
         virtual void execute() override
         {
-            action(value);
+            (*action)(value);
         }
     };
 
@@ -206,20 +228,30 @@ struct triggered_transition_delegate : public transition_delegate
         auto self = std::static_pointer_cast<this_type>(this->shared_from_this());
         auto observable_factory = [self, transitions](const transition_resource&) {
             return self->trigger.map([transitions](const value_type& v) -> transition_data {
-                auto self = transitions.front();
+                auto self = transitions.front().get();
                 if (self->blocked.load()) {
-                    return std::make_tuple(std::shared_ptr<virtual_vertex_delegate>(), std::shared_ptr<transition_delegate>(), std::shared_ptr<transition_delegate::action>());
+                    return transition_data(nullptr, nullptr, std::shared_ptr<transition_delegate::action>());
                 }
                 for(const auto& t : transitions)
                 {
-                    auto tt = std::static_pointer_cast<this_type>(t);
-                    t->guard_executed();
-                    if (tt->guard(v)) {
-                        auto source = self->owner<virtual_vertex_delegate>();
-                        return std::make_tuple(source, t, std::make_shared<typed_action>(tt->action, v));
+                    auto tt = static_cast<this_type*>(t.get());
+                    tt->guard_executed();
+#if defined(RXCPP_FSM_TRACING)
+                    auto start = tt->trace_start();
+                    auto passed = tt->guard(v);
+                    tt->trace_guard(start, passed);
+#else
+                    auto passed = tt->guard(v);
+#endif
+                    if (RX_FSM_PROBE_ENABLED(guard)) {
+                        tt->probe_guard(passed);
+                    }
+                    if (passed) {
+                        return transition_data(self->frozen_source, tt, std::make_shared<typed_action>(tt->action, v));
                     }
                 }
-                return std::make_tuple(std::shared_ptr<virtual_vertex_delegate>(), std::shared_ptr<transition_delegate>(), std::shared_ptr<transition_delegate::action>());
+                RX_FSM_TRACE(self->trace_unhandled());
+                return transition_data(nullptr, nullptr, std::shared_ptr<transition_delegate::action>());
             }).filter([](const transition_data& data) {
                 return std::get<0>(data);
             });
@@ -257,11 +289,20 @@ struct triggered_transition_delegate : public transition_delegate
 
 std::vector<std::shared_ptr<transition_delegate>> type_filtered_transitions(transition_delegate::transition_t type, const std::vector<std::shared_ptr<transition_delegate>>& transitions);
 
+// creates a timer on the virtual time of the state machine of a vertex, returns false if the state machine runs in real time
+bool create_virtual_timer(const std::shared_ptr<virtual_vertex_delegate>& owner, rxsc::scheduler::clock_type::duration dur, observable<long>& timer);
+
 template<class Coordination>
-observable<long> create_timeout_trigger(Coordination cn, rxsc::scheduler::clock_type::duration dur)
+observable<long> create_timeout_trigger(Coordination cn, rxsc::scheduler::clock_type::duration dur, const std::shared_ptr<virtual_vertex_delegate>& owner)
 {
-    auto factory = [cn, dur]() {
-        return observable<>::timer(dur, cn);
+    std::weak_ptr<virtual_vertex_delegate> weak = owner;
+    auto factory = [cn, dur, weak]() {
+        observable<long> timer;
+        auto o = weak.lock();
+        if (o && create_virtual_timer(o, dur, timer)) {
+            return timer;
+        }
+        return observable<>::timer(dur, cn).as_dynamic();
     };
     return observable<>::defer(factory);
 }
@@ -289,7 +330,7 @@ typename std::enable_if<rxu::all_true<is_coordination<Coordination>::value,
                                              is_vertex<TargetState>::value>::value, std::shared_ptr<transition_delegate>>::type
     make_transition(bool guarded, std::string name, const std::shared_ptr<virtual_vertex_delegate>& owner, const TargetState& target, Coordination cn, rxsc::scheduler::clock_type::duration dur, transition_delegate::void_action_t action, transition_delegate::void_guard_t guard)
 {
-    typedef typename std::result_of<decltype(&create_timeout_trigger<Coordination>)(Coordination, rxsc::scheduler::clock_type::duration)>::type observable_type;
+    typedef observable<long> observable_type;
     typedef typename triggered_transition_delegate<observable_type>::value_type value_type;
     typedef typename triggered_transition_delegate<observable_type>::action_t action_t;
     typedef typename triggered_transition_delegate<observable_type>::guard_t guard_t;
@@ -300,7 +341,7 @@ typename std::enable_if<rxu::all_true<is_coordination<Coordination>::value,
         return guard();
     };
     std::shared_ptr<virtual_vertex_delegate> tgt = std::dynamic_pointer_cast<virtual_vertex_delegate>(target());
-    auto trigger = create_timeout_trigger<Coordination>(std::move(cn), dur);
+    auto trigger = create_timeout_trigger<Coordination>(std::move(cn), dur, owner);
     return std::make_shared<triggered_transition_delegate<observable_type>>(guarded, tgt, std::move(trigger), std::move(name), owner, std::move(a), std::move(g), detail::transition_delegate::timeout);
 }
 
@@ -308,7 +349,7 @@ template<class Coordination>
 typename std::enable_if<is_coordination<Coordination>::value, std::shared_ptr<transition_delegate>>::type
     make_transition(bool guarded, std::string name, const std::shared_ptr<virtual_vertex_delegate>& owner, Coordination cn, rxsc::scheduler::clock_type::duration dur, transition_delegate::void_action_t action, transition_delegate::void_guard_t guard)
 {
-    typedef typename std::result_of<decltype(&create_timeout_trigger<Coordination>)(Coordination, rxsc::scheduler::clock_type::duration)>::type observable_type;
+    typedef observable<long> observable_type;
     typedef typename triggered_transition_delegate<observable_type>::value_type value_type;
     typedef typename triggered_transition_delegate<observable_type>::action_t action_t;
     typedef typename triggered_transition_delegate<observable_type>::guard_t guard_t;
@@ -318,7 +359,7 @@ typename std::enable_if<is_coordination<Coordination>::value, std::shared_ptr<tr
     guard_t g = [guard](const value_type&) {
         return guard();
     };
-    auto trigger = create_timeout_trigger<Coordination>(std::move(cn), dur);
+    auto trigger = create_timeout_trigger<Coordination>(std::move(cn), dur, owner);
     return std::make_shared<triggered_transition_delegate<observable_type>>(guarded, std::move(trigger), std::move(name), owner, std::move(a), std::move(g), detail::transition_delegate::timeout);
 }
 
@@ -0,0 +1,99 @@
+/*! \file  rx-fsm-virtual_time.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_VIRTUAL_TIME_HPP)
+#define RX_FSM_VIRTUAL_TIME_HPP
+
+#include "rxcpp/rx-test.hpp"
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+struct virtual_time_delegate
+{
+    typedef virtual_time_delegate this_type;
+
+    rxsc::test scheduler;
+    rxsc::test::test_worker worker;
+
+    virtual_time_delegate();
+};
+
+}
+
+/*!  \brief  Virtual clock of state machines, i.e. a clock that only advances when told to.
+
+     A state machine running on a virtual time (see \a state_machine::with_virtual_time) schedules all its timeout
+     transitions on the virtual clock instead of the real one, regardless of the coordination the transition was
+     defined with. A timeout expires when the clock is advanced past it, and its transition is executed on the
+     thread advancing the clock, i.e. hours of timeouts are simulated in the time it takes to execute the transitions.
+     Start the state machine on e.g. identity_immediate() for the simulation to be deterministic.
+
+     \note  The class uses reference semantics. It is not thread safe, the clock must be advanced by one thread at a time.
+ */
+class virtual_time final
+{
+public:
+
+    typedef virtual_time this_type;
+    typedef detail::virtual_time_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit virtual_time(std::shared_ptr<delegate_type> d);
+
+    friend virtual_time make_virtual_time();
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \return  A coordination of the virtual clock, e.g. for other timers of the simulation.
+     */
+    identity_one_worker coordination() const;
+
+    /*!  \return  The current virtual time.
+     */
+    rxsc::scheduler::clock_type::time_point now() const;
+
+    /*!  \brief  Advances the clock, executing the timeouts expiring until then in order.
+
+         \param duration  The duration to advance the clock by, with millisecond resolution.
+     */
+    void advance_by(rxsc::scheduler::clock_type::duration duration) const;
+
+    /*!  \brief  Advances the clock to a point in time, executing the timeouts expiring until then in order.
+
+         \param time  The time to advance the clock to, with millisecond resolution. Must not be before \a now.
+     */
+    void advance_to(rxsc::scheduler::clock_type::time_point time) const;
+};
+
+/*! \brief Creates a virtual clock, starting at time zero.
+
+    \return  A \a virtual_time instance.
+ */
+virtual_time make_virtual_time();
+
+}
+}
+
+#endif
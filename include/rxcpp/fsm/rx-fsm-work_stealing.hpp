@@ -0,0 +1,111 @@
+/*! \file  rx-fsm-work_stealing.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_WORK_STEALING_HPP)
+#define RX_FSM_WORK_STEALING_HPP
+
+#include <cstdint>
+
+#include "rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+/*!  \brief  Run time statistics of a \a work_stealing scheduler.
+ */
+struct work_stealing_stats
+{
+    /*!  Number of worker threads.
+     */
+    std::size_t threads;
+
+    /*!  Number of strands created, i.e. number of workers created from the scheduler.
+     */
+    std::size_t strands;
+
+    /*!  Number of times a strand was scheduled to run on a worker thread.
+     */
+    std::uint64_t runs;
+
+    /*!  Number of times an idle worker thread stole a strand from another worker thread.
+     */
+    std::uint64_t steals;
+};
+
+namespace detail {
+
+struct work_stealing_delegate;
+
+}
+
+/*!  \brief  Work stealing scheduler for many small state machines.
+
+     Every worker created from the scheduler is a strand, i.e. a serialized queue of actions that never executes
+     concurrently with itself, so a state machine assembled on a coordination of one such worker needs no further
+     serialization. Ready strands are kept in one deque per worker thread. A strand is always queued on the worker
+     thread it last ran on, preserving cache locality. Each worker thread runs its strands in FIFO order, and a
+     worker thread that runs out of strands steals whole strands from the others, taking the one queued last, i.e.
+     the one its owner would run last. A strand executes a bounded batch of actions each time it runs, so a hot state machine
+     does not starve the other strands queued on the same worker thread.
+
+     \note  The class uses reference semantics.
+ */
+class work_stealing final
+{
+public:
+
+    typedef work_stealing this_type;
+    typedef detail::work_stealing_delegate delegate_type;
+
+private:
+
+    std::shared_ptr<delegate_type> delegate;
+
+    explicit work_stealing(std::shared_ptr<delegate_type> d);
+
+    friend work_stealing make_work_stealing(std::size_t threads);
+
+public:
+
+    /*!  \brief  Returns the implementation specific delegate object.
+
+         \return  The implementation specific delegate object.
+     */
+    const std::shared_ptr<delegate_type>& operator()() const
+    {
+       return delegate;
+    }
+
+    /*!  \return  The rxcpp scheduler, each worker created is a strand.
+     */
+    rxsc::scheduler get_scheduler() const;
+
+    /*!  \brief  Creates a coordination of a new strand, to be used when assembling one state machine.
+
+         \return  The coordination.
+     */
+    identity_same_worker create_coordination() const;
+
+    /*!  \return  The run time statistics.
+     */
+    work_stealing_stats stats() const;
+};
+
+/*!  \brief Creates a work stealing scheduler.
+
+     \param threads  Number of worker threads, zero means one per hardware thread.
+
+     \return  A \a work_stealing instance.
+ */
+work_stealing make_work_stealing(std::size_t threads = 0);
+
+}
+}
+
+#endif
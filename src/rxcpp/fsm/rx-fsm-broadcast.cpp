@@ -0,0 +1,96 @@
+/*! \file  rx-fsm-broadcast.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-broadcast.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+broadcast_dispatcher_delegate::broadcast_dispatcher_delegate()
+{
+    maps.emplace_back(new interest_map());
+    interested.store(maps.back().get());
+}
+
+event_source_registry& broadcast_dispatcher_delegate::interest_of(const event_id& id)
+{
+    auto* current = interested.load();
+    auto it = current->find(id);
+    if (it != current->end()) {
+        return *it->second;
+    }
+    registries.emplace_back(new event_source_registry());
+    auto* next = new interest_map(*current);
+    maps.emplace_back(next);
+    (*next)[id] = registries.back().get();
+    interested.store(next);
+    return *registries.back();
+}
+
+void broadcast_dispatcher_delegate::add_interest(const std::shared_ptr<event_slot_base>& slot)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (slot->subscribers++ == 0) {
+        slot->interest = interest_of(slot->id).add(std::unique_ptr<event_source_node>(new interested_slot(slot)));
+    }
+}
+
+void broadcast_dispatcher_delegate::remove_interest(event_slot_base& slot)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (slot.subscribers == 0 || --slot.subscribers > 0) {
+        return;
+    }
+    auto* registry = interested_slots(slot.id);
+    if (registry) {
+        registry->remove(slot.interest);
+    }
+}
+
+event_source_registry* broadcast_dispatcher_delegate::interested_slots(const event_id& id) const
+{
+    auto* current = interested.load();
+    auto it = current->find(id);
+    if (it == current->end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+std::size_t broadcast_dispatcher_delegate::interested_count(const event_id& id) const
+{
+    auto* registry = interested_slots(id);
+    return registry ? registry->size() : 0;
+}
+
+}
+
+broadcast_dispatcher::broadcast_dispatcher(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+std::size_t broadcast_dispatcher::fire(const event_id& id) const
+{
+    return fire(id, id);
+}
+
+std::size_t broadcast_dispatcher::interested(const event_id& id) const
+{
+    return delegate->interested_count(id);
+}
+
+broadcast_dispatcher make_broadcast_dispatcher()
+{
+    return broadcast_dispatcher(std::make_shared<detail::broadcast_dispatcher_delegate>());
+}
+
+}
+}
@@ -0,0 +1,138 @@
+/*! \file  rx-fsm-buffer.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include <cstring>
+
+#include "rxcpp/fsm/rx-fsm-buffer.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+buffer_block* buffer_pool_delegate::acquire(std::size_t size)
+{
+    buffer_block* block(nullptr);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!cached.empty()) {
+            block = cached.back();
+            cached.pop_back();
+            ++counters.recycled;
+            --counters.cached;
+        } else {
+            ++counters.allocated;
+        }
+    }
+    if (!block) {
+        block = new buffer_block();
+    }
+    // keeps the capacity of a recycled block, i.e. equally sized messages do not allocate
+    block->bytes.resize(size);
+    block->references.store(1);
+    block->pool = shared_from_this();
+    return block;
+}
+
+void buffer_pool_delegate::release(buffer_block* block)
+{
+    auto pool = std::move(block->pool);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (cached.size() < max_cached) {
+            cached.push_back(block);
+            ++counters.cached;
+            return;
+        }
+    }
+    delete block;
+}
+
+buffer_pool_delegate::buffer_pool_delegate(std::size_t max)
+    : max_cached(max)
+{
+    counters.allocated = 0;
+    counters.recycled = 0;
+    counters.cached = 0;
+}
+
+buffer_pool_delegate::~buffer_pool_delegate()
+{
+    for(auto block : cached)
+    {
+        delete block;
+    }
+}
+
+}
+
+buffer::buffer()
+    : block(nullptr)
+{
+}
+
+buffer::buffer(detail::buffer_block* b)
+    : block(b)
+{
+}
+
+buffer::buffer(const buffer& other)
+    : block(other.block)
+{
+    if (block) {
+        block->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+buffer::buffer(buffer&& other)
+    : block(other.block)
+{
+    other.block = nullptr;
+}
+
+buffer& buffer::operator=(buffer other)
+{
+    std::swap(block, other.block);
+    return *this;
+}
+
+buffer::~buffer()
+{
+    if (block && block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        auto pool = block->pool;
+        pool->release(block);
+    }
+}
+
+buffer_pool::buffer_pool(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+buffer buffer_pool::copy(const void* data, std::size_t size) const
+{
+    buffer b(delegate->acquire(size));
+    if (size > 0) {
+        std::memcpy(const_cast<std::uint8_t*>(b.data()), data, size);
+    }
+    return b;
+}
+
+buffer_pool_stats buffer_pool::stats() const
+{
+    std::lock_guard<std::mutex> guard(delegate->lock);
+    return delegate->counters;
+}
+
+buffer_pool make_buffer_pool(std::size_t max_cached)
+{
+    return buffer_pool(std::make_shared<detail::buffer_pool_delegate>(max_cached));
+}
+
+}
+}
@@ -0,0 +1,104 @@
+/*! \file  rx-fsm-busy_poll.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-busy_poll.hpp"
+
+#include "rxcpp/fsm/rx-fsm-run_loop.hpp"
+
+#include <thread>
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+struct poll_state;
+
+thread_local poll_state* current_poller = nullptr;
+
+struct poll_state : public run_loop<poll_state, spin_then_park>
+{
+    explicit poll_state(std::chrono::nanoseconds spin_budget)
+        : run_loop(spin_budget)
+    {
+    }
+
+    void post(run_loop_clock::time_point when, const rxsc::schedulable& what)
+    {
+        run_loop_item item = {when, 0, what};
+        if (current_poller == this) {
+            post_local(std::move(item));
+            return;
+        }
+        post_inbox(std::move(item));
+    }
+};
+
+}
+
+struct busy_poll_delegate
+{
+    std::shared_ptr<poll_state> state;
+    rxsc::scheduler scheduler;
+    std::thread thread;
+
+    busy_poll_delegate(std::chrono::nanoseconds spin_budget, int core)
+        : state(std::make_shared<poll_state>(spin_budget))
+        , scheduler(rxsc::make_scheduler<run_loop_scheduler<poll_state>>(state))
+    {
+        auto s = state;
+        thread = std::thread([s, core]() {
+            if (core >= 0) {
+                pin_current_thread(static_cast<std::size_t>(core));
+            }
+            current_poller = s.get();
+            s->loop();
+            current_poller = nullptr;
+        });
+    }
+
+    ~busy_poll_delegate()
+    {
+        state->shutdown();
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+    }
+};
+
+}
+
+busy_poll::busy_poll(std::shared_ptr<delegate_type> d)
+    : identity_one_worker(d->scheduler)
+    , delegate(std::move(d))
+{
+}
+
+busy_poll_stats busy_poll::stats() const
+{
+    const auto& state = delegate->state;
+    busy_poll_stats s;
+    s.executed = state->executed.load();
+    s.parks = state->parks.load();
+    s.working = std::chrono::nanoseconds(state->working.load());
+    s.spinning = std::chrono::nanoseconds(state->idle_policy.spinning.load());
+    s.parked = std::chrono::nanoseconds(state->parked_time.load());
+    return s;
+}
+
+busy_poll make_busy_poll(std::chrono::nanoseconds spin_budget, int core)
+{
+    return busy_poll(std::make_shared<detail::busy_poll_delegate>(spin_budget, core));
+}
+
+}
+}
@@ -0,0 +1,417 @@
+/*! \file  rx-fsm-chrome_trace.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "rxcpp/fsm/rx-fsm-chrome_trace.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+void write_string(std::ostream& out, const std::string& s)
+{
+    out << '"';
+    for(auto c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+// trace event timestamps are microseconds
+void write_us(std::ostream& out, std::uint64_t ns)
+{
+    char us[32];
+    std::snprintf(us, sizeof(us), "%llu.%03u", static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000));
+    out << us;
+}
+
+// the buffers of the tracers the thread traced to, flagged orphaned when the thread exits
+struct thread_buffers
+{
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<chrome_trace_delegate::thread_buffer>>> buffers;
+
+    ~thread_buffers()
+    {
+        for(const auto& b : buffers)
+        {
+            b.second->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+std::atomic<std::uint64_t> next_id(0);
+
+}
+
+chrome_trace_delegate::thread_buffer::thread_buffer(std::size_t capacity)
+    : records(new record[capacity])
+    , head(0)
+    , tail(0)
+    , orphaned(false)
+    , released(false)
+{
+}
+
+chrome_trace_delegate::chrome_trace_delegate(std::shared_ptr<std::ostream> o, std::size_t n, std::size_t c)
+    : id(next_id.fetch_add(1))
+    , out(std::move(o))
+    , sample_every(std::max<std::size_t>(n, 1))
+    , capacity(std::max<std::size_t>(c, 1))
+    , dropped(0)
+    , stopping(false)
+    , half_full(false)
+    , first(true)
+    , closed(false)
+{
+    *out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    writer = std::thread([this]() {
+        run();
+    });
+}
+
+chrome_trace_delegate::~chrome_trace_delegate()
+{
+    close();
+    std::lock_guard<std::mutex> guard(buffers_lock);
+    for(const auto& b : buffers)
+    {
+        b->released.store(true, std::memory_order_release);
+    }
+}
+
+chrome_trace_delegate::thread_buffer& chrome_trace_delegate::local()
+{
+    static thread_local thread_buffers mine;
+    for(const auto& b : mine.buffers)
+    {
+        if (b.first == id) {
+            return *b.second;
+        }
+    }
+    mine.buffers.erase(std::remove_if(mine.buffers.begin(), mine.buffers.end(), [](const std::pair<std::uint64_t, std::shared_ptr<thread_buffer>>& b) {
+        return b.second->released.load(std::memory_order_acquire);
+    }), mine.buffers.end());
+    auto b = std::make_shared<thread_buffer>(capacity);
+    {
+        std::lock_guard<std::mutex> guard(buffers_lock);
+        buffers.push_back(b);
+    }
+    mine.buffers.emplace_back(id, b);
+    return *b;
+}
+
+void chrome_trace_delegate::push(const record& r)
+{
+    if (stopping.load(std::memory_order_relaxed)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& b = local();
+    auto head = b.head.load(std::memory_order_relaxed);
+    auto used = head - b.tail.load(std::memory_order_acquire);
+    if (used >= capacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    b.records[head % capacity] = r;
+    b.head.store(head + 1, std::memory_order_release);
+    if (used + 1 == capacity / 2) {
+        // the writer also drains periodically, i.e. a notification missed while it is busy is harmless
+        half_full.store(true, std::memory_order_relaxed);
+        wake.notify_one();
+    }
+}
+
+void chrome_trace_delegate::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping.load())
+    {
+        wake.wait_for(guard, std::chrono::milliseconds(100), [this]() {
+            return stopping.load() || half_full.load(std::memory_order_relaxed);
+        });
+        half_full.store(false, std::memory_order_relaxed);
+        guard.unlock();
+        drain();
+        guard.lock();
+    }
+}
+
+void chrome_trace_delegate::drain()
+{
+    std::lock_guard<std::mutex> write_guard(write_lock);
+    std::vector<std::shared_ptr<thread_buffer>> current;
+    {
+        std::lock_guard<std::mutex> guard(buffers_lock);
+        current = buffers;
+    }
+    bool written(false);
+    std::vector<const thread_buffer*> exhausted;
+    {
+        std::lock_guard<std::mutex> names_guard(names_lock);
+        for(const auto& b : current)
+        {
+            // a buffer orphaned before it is drained receives no more trace points
+            auto orphaned = b->orphaned.load(std::memory_order_acquire);
+            auto tail = b->tail.load(std::memory_order_relaxed);
+            auto head = b->head.load(std::memory_order_acquire);
+            for(; tail != head; ++tail)
+            {
+                write(b->records[tail % capacity]);
+                written = true;
+            }
+            b->tail.store(tail, std::memory_order_release);
+            if (orphaned) {
+                exhausted.push_back(b.get());
+            }
+        }
+    }
+    if (!exhausted.empty()) {
+        std::lock_guard<std::mutex> guard(buffers_lock);
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [&exhausted](const std::shared_ptr<thread_buffer>& b) {
+            return std::find(exhausted.begin(), exhausted.end(), b.get()) != exhausted.end();
+        }), buffers.end());
+    }
+    if (written) {
+        out->flush();
+    }
+}
+
+void chrome_trace_delegate::write(const record& r)
+{
+    static const std::string unknown("?");
+    auto it = names.find(r.machine);
+    auto known = it != names.end();
+    auto vertex_name = [&it, known](std::uint32_t v) -> const std::string& {
+        return known && v < it->second.vertices.size() ? it->second.vertices[v] : unknown;
+    };
+    auto transition_name = [&it, known](std::uint32_t t) -> const std::string& {
+        return known && t < it->second.transitions.size() ? it->second.transitions[t] : unknown;
+    };
+    auto begin = [this, &r](const char* phase, const char* category, const std::string& name, std::uint64_t time) {
+        *out << (first ? "\n" : ",\n") << "{\"ph\":\"" << phase << "\",\"cat\":\"" << category << "\",\"name\":";
+        write_string(*out, name);
+        *out << ",\"pid\":1,\"tid\":" << r.machine << ",\"ts\":";
+        write_us(*out, time);
+        first = false;
+    };
+    auto slice = [this, &begin](const char* category, const std::string& name, std::uint64_t start, std::uint64_t end) {
+        begin("X", category, name, start);
+        *out << ",\"dur\":";
+        write_us(*out, end > start ? end - start : 0);
+    };
+    auto instant = [this, &begin](const char* category, const std::string& name, std::uint64_t time) {
+        begin("i", category, name, time);
+        *out << ",\"s\":\"t\"";
+    };
+    switch (r.kind)
+    {
+    case assembled_kind:
+        *out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << r.machine << ",\"args\":{\"name\":";
+        write_string(*out, known ? it->second.name : unknown);
+        *out << "}}";
+        first = false;
+        return;
+    case guard_kind:
+        slice("guard", "guard", r.start, r.end);
+        *out << ",\"args\":{\"transition\":";
+        write_string(*out, transition_name(r.id));
+        *out << ",\"passed\":" << (r.flag ? "true" : "false") << "}";
+        break;
+    case action_kind:
+        instant("transition", transition_name(r.id), r.start);
+        *out << "}";
+        slice("action", "action", r.start, r.end);
+        *out << ",\"args\":{\"transition\":";
+        write_string(*out, transition_name(r.id));
+        *out << "}";
+        break;
+    case entered_kind:
+        slice("action", "entry", r.start, r.end);
+        break;
+    case exited_kind:
+        if (r.value) {
+            // the state was entered in a sampled step, i.e. its whole active time is known
+            slice("state", vertex_name(r.id), r.value, r.end);
+            *out << "}";
+        }
+        slice("action", "exit", r.start, r.end);
+        break;
+    case history_kind:
+        instant("history", "history restored", r.start);
+        *out << ",\"args\":{\"history\":";
+        write_string(*out, vertex_name(r.id));
+        *out << ",\"states\":" << r.value << "}";
+        break;
+    case region_kind:
+        instant("region", r.flag ? "regions completed" : "region completed", r.start);
+        *out << ",\"args\":{\"vertex\":";
+        write_string(*out, vertex_name(r.id));
+        *out << "}";
+        break;
+    case ignored_kind:
+        instant("event", "event ignored", r.start);
+        *out << ",\"args\":{\"event\":" << r.value << "}";
+        break;
+    case unhandled_kind:
+        instant("event", "event unhandled", r.start);
+        *out << ",\"args\":{\"state\":";
+        write_string(*out, vertex_name(r.id));
+        *out << "}";
+        break;
+    }
+    *out << "}";
+}
+
+void chrome_trace_delegate::flush()
+{
+    drain();
+}
+
+void chrome_trace_delegate::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping.load()) {
+            return;
+        }
+        stopping.store(true);
+    }
+    wake.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    drain();
+    std::lock_guard<std::mutex> write_guard(write_lock);
+    if (!closed) {
+        closed = true;
+        *out << "\n]}\n";
+        out->flush();
+    }
+}
+
+void chrome_trace_delegate::assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions)
+{
+    {
+        std::lock_guard<std::mutex> guard(names_lock);
+        auto& n = names[machine];
+        n.name = name;
+        n.vertices = vertices;
+        n.transitions = transitions;
+    }
+    push(record{assembled_kind, false, machine, 0, 0, 0, 0});
+}
+
+bool chrome_trace_delegate::sample(std::uint32_t, std::uint64_t step)
+{
+    return step % sample_every == 0;
+}
+
+void chrome_trace_delegate::guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed)
+{
+    push(record{guard_kind, passed, machine, transition, start, end, 0});
+}
+
+void chrome_trace_delegate::action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition)
+{
+    push(record{action_kind, false, machine, transition, start, end, 0});
+}
+
+void chrome_trace_delegate::state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state)
+{
+    push(record{entered_kind, false, machine, state, start, end, 0});
+}
+
+void chrome_trace_delegate::state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered)
+{
+    push(record{exited_kind, false, machine, state, start, end, entered});
+}
+
+void chrome_trace_delegate::history_restored(std::uint32_t machine, std::uint64_t time, std::uint32_t history, std::size_t states)
+{
+    push(record{history_kind, false, machine, history, time, time, states});
+}
+
+void chrome_trace_delegate::region_completed(std::uint32_t machine, std::uint64_t time, std::uint32_t vertex, bool completed)
+{
+    push(record{region_kind, completed, machine, vertex, time, time, 0});
+}
+
+void chrome_trace_delegate::event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event)
+{
+    push(record{ignored_kind, false, machine, 0, time, time, event});
+}
+
+void chrome_trace_delegate::event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state)
+{
+    push(record{unhandled_kind, false, machine, state, time, time, 0});
+}
+
+}
+
+chrome_trace::chrome_trace(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+std::shared_ptr<tracer> chrome_trace::get_tracer() const
+{
+    return delegate;
+}
+
+void chrome_trace::flush() const
+{
+    delegate->flush();
+}
+
+void chrome_trace::close() const
+{
+    delegate->close();
+}
+
+std::uint64_t chrome_trace::dropped() const
+{
+    return delegate->dropped.load(std::memory_order_relaxed);
+}
+
+chrome_trace make_chrome_trace(std::shared_ptr<std::ostream> out, std::size_t sample_every, std::size_t capacity)
+{
+    return chrome_trace(std::make_shared<chrome_trace::delegate_type>(std::move(out), sample_every, capacity));
+}
+
+chrome_trace make_chrome_trace(const std::string& path, std::size_t sample_every, std::size_t capacity)
+{
+    return make_chrome_trace(std::make_shared<std::ofstream>(path), sample_every, capacity);
+}
+
+}
+}
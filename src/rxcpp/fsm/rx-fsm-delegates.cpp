@@ -38,11 +38,15 @@ bool virtual_region_delegate::contains(const std::shared_ptr<virtual_vertex_dele
 
 virtual_region_delegate::virtual_region_delegate(std::string n, const std::shared_ptr<element_delegate>& o)
     : element_delegate(std::move(n), o)
+    , shallow_history(no_index)
+    , deep_history(no_index)
 {
 }
 
 virtual_region_delegate::virtual_region_delegate(std::string n)
     : element_delegate(std::move(n))
+    , shallow_history(no_index)
+    , deep_history(no_index)
 {
 }
 
@@ -83,11 +87,13 @@ void virtual_vertex_delegate::validate() const
 
 virtual_vertex_delegate::virtual_vertex_delegate(std::string n, const std::shared_ptr<element_delegate>& o)
     : element_delegate(std::move(n), o)
+    , id(0)
 {
 }
 
 virtual_vertex_delegate::virtual_vertex_delegate(std::string n)
     : element_delegate(std::move(n))
+    , id(0)
 {
 }
 
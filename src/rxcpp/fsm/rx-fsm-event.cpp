@@ -0,0 +1,207 @@
+/*! \file  rx-fsm-event.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-event.hpp"
+#include "rxcpp/fsm/rx-fsm-broadcast.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+const std::uint64_t interned_flag = std::uint64_t(1) << 63;
+
+struct intern_table
+{
+    std::mutex lock;
+    std::unordered_map<std::string, std::uint64_t> ids;
+    std::vector<std::string> names;
+};
+
+intern_table& interned()
+{
+    static intern_table table;
+    return table;
+}
+
+std::uint64_t intern(const std::string& name)
+{
+    auto& table = interned();
+    std::lock_guard<std::mutex> guard(table.lock);
+    auto it = table.ids.find(name);
+    if (it != table.ids.end()) {
+        return it->second;
+    }
+    auto id = interned_flag | table.names.size();
+    table.names.push_back(name);
+    table.ids[name] = id;
+    return id;
+}
+
+std::string interned_name(std::uint64_t id)
+{
+    auto& table = interned();
+    std::lock_guard<std::mutex> guard(table.lock);
+    return table.names[static_cast<std::size_t>(id & ~interned_flag)];
+}
+
+std::uint64_t mix(std::uint64_t x)
+{
+    // splitmix64 finalizer, a bijection on 64 bit values
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+const std::uint32_t max_displacement = 1 << 24;
+
+}
+
+void event_slot_base::interest_added()
+{
+    auto d = dispatcher.lock();
+    if (d) {
+        d->add_interest(shared_from_this());
+    }
+}
+
+void event_slot_base::interest_removed()
+{
+    auto d = dispatcher.lock();
+    if (d) {
+        d->remove_interest(*this);
+    }
+}
+
+event_slot_base::event_slot_base(event_id i, const std::type_info& t)
+    : id(std::move(i))
+    , type(t)
+    , subscribers(0)
+    , interest()
+{
+}
+
+std::size_t event_table::bucket(std::uint64_t key) const
+{
+    return static_cast<std::size_t>(mix(key) % displacements.size());
+}
+
+std::size_t event_table::position(std::uint64_t key, std::uint32_t displacement) const
+{
+    return static_cast<std::size_t>(mix(key ^ mix(displacement)) % slots.size());
+}
+
+void event_table::build(std::vector<std::shared_ptr<event_slot_base>> s)
+{
+    displacements.clear();
+    slots.clear();
+    if (s.empty()) {
+        return;
+    }
+    auto n = s.size();
+    displacements.assign((n + 1) / 2, 0);
+    slots.resize(n);
+    std::vector<std::vector<std::shared_ptr<event_slot_base>>> buckets(displacements.size());
+    for(auto& slot : s)
+    {
+        buckets[bucket(slot->id.value())].push_back(std::move(slot));
+    }
+    std::vector<std::size_t> order(buckets.size());
+    for(std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    // place the largest buckets first, while there is still room
+    std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t lhs, std::size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+    std::vector<std::size_t> positions;
+    for(auto b : order)
+    {
+        auto& items = buckets[b];
+        if (items.empty()) {
+            break;
+        }
+        std::uint32_t d(0);
+        for(;; ++d)
+        {
+            if (d == max_displacement) {
+                throw internal_error("unable to generate event table");
+            }
+            positions.clear();
+            bool ok(true);
+            for(const auto& item : items)
+            {
+                auto p = position(item->id.value(), d);
+                if (slots[p] || std::find(positions.begin(), positions.end(), p) != positions.end()) {
+                    ok = false;
+                    break;
+                }
+                positions.push_back(p);
+            }
+            if (ok) {
+                break;
+            }
+        }
+        displacements[b] = d;
+        for(std::size_t i = 0; i < items.size(); ++i)
+        {
+            slots[positions[i]] = std::move(items[i]);
+        }
+    }
+}
+
+event_table_stats event_table::stats() const
+{
+    event_table_stats s;
+    s.events = slots.size();
+    s.buckets = displacements.size();
+    s.bytes = sizeof(*this) + displacements.size() * sizeof(std::uint32_t) + slots.size() * sizeof(std::shared_ptr<event_slot_base>);
+    return s;
+}
+
+}
+
+event_id::event_id(const std::string& name)
+    : value_(detail::intern(name))
+{
+}
+
+event_id::event_id(const char* name)
+    : value_(detail::intern(name))
+{
+}
+
+event_id::event_id(std::uint64_t value)
+    : value_(value)
+{
+    if (value_ & detail::interned_flag) {
+        throw not_allowed("event id value is out of range");
+    }
+}
+
+bool event_id::is_interned() const
+{
+    return (value_ & detail::interned_flag) != 0;
+}
+
+std::string event_id::name() const
+{
+    if (is_interned()) {
+        return detail::interned_name(value_);
+    }
+    std::ostringstream s;
+    s << value_;
+    return s.str();
+}
+
+}
+}
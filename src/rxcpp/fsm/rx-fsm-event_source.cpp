@@ -0,0 +1,158 @@
+/*! \file  rx-fsm-event_source.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-event_source.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+event_source_registry::slot& event_source_registry::at(std::size_t index)
+{
+    std::size_t k(0);
+    while (index >= segment_size(k))
+    {
+        index -= segment_size(k);
+        ++k;
+    }
+    return segments[k].load()[index];
+}
+
+event_source_registry::handle event_source_registry::add(std::unique_ptr<event_source_node> node)
+{
+    std::lock_guard<std::mutex> guard(writer);
+    std::size_t index;
+    if (!free_slots.empty()) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        index = high_water.load();
+        std::size_t k(0), capacity(0);
+        while (capacity + segment_size(k) <= index)
+        {
+            capacity += segment_size(k);
+            ++k;
+        }
+        if (k == segment_count) {
+            throw std::length_error("too many event source subscribers");
+        }
+        if (!segments[k].load()) {
+            auto* segment = new slot[segment_size(k)];
+            for(std::size_t i = 0; i < segment_size(k); ++i)
+            {
+                segment[i].generation.store(0);
+                segment[i].added.store(0);
+                segment[i].node.store(nullptr);
+            }
+            segments[k].store(segment);
+        }
+    }
+    auto& s = at(index);
+    auto generation = s.generation.load() + 1;
+    s.generation.store(generation);
+    auto added = sequence.load() + 1;
+    s.added.store(added);
+    s.node.store(node.release());
+    sequence.store(added);
+    if (index == high_water.load()) {
+        high_water.store(index + 1);
+    }
+    ++count;
+    reclaim();
+    handle h;
+    h.index = index;
+    h.generation = generation;
+    return h;
+}
+
+void event_source_registry::remove(const handle& h)
+{
+    std::lock_guard<std::mutex> guard(writer);
+    auto& s = at(h.index);
+    if (s.generation.load() != h.generation) {
+        // already removed
+        return;
+    }
+    s.generation.store(h.generation + 1);
+    auto* node = s.node.exchange(nullptr);
+    free_slots.push_back(h.index);
+    --count;
+    retired[epoch.load() & 1].push_back(node);
+    retired_count.fetch_add(1);
+    reclaim();
+}
+
+void event_source_registry::reclaim()
+{
+    // nodes retired during epoch e - 1 may be deleted when advancing from e to e + 1,
+    // provided no reader registered in epoch e - 1 remains
+    for(int i = 0; i < 2 && retired_count.load() > 0; ++i)
+    {
+        auto e = epoch.load();
+        auto previous = static_cast<std::size_t>((e + 1) & 1);
+        if (readers[previous].load() != 0) {
+            return;
+        }
+        auto& nodes = retired[previous];
+        for(auto* node : nodes)
+        {
+            delete node;
+        }
+        retired_count.fetch_sub(nodes.size());
+        nodes.clear();
+        epoch.store(e + 1);
+    }
+}
+
+std::size_t event_source_registry::size() const
+{
+    std::lock_guard<std::mutex> guard(const_cast<std::mutex&>(writer));
+    return count;
+}
+
+event_source_registry::event_source_registry()
+    : high_water(0)
+    , sequence(0)
+    , epoch(0)
+    , retired_count(0)
+    , count(0)
+{
+    for(auto& segment : segments)
+    {
+        segment.store(nullptr);
+    }
+    readers[0].store(0);
+    readers[1].store(0);
+}
+
+event_source_registry::~event_source_registry()
+{
+    for(auto& nodes : retired)
+    {
+        for(auto* node : nodes)
+        {
+            delete node;
+        }
+    }
+    for(std::size_t k = 0; k < segment_count; ++k)
+    {
+        auto* segment = segments[k].load();
+        if (segment) {
+            for(std::size_t i = 0; i < segment_size(k); ++i)
+            {
+                delete segment[i].node.load();
+            }
+            delete[] segment;
+        }
+    }
+}
+
+}
+}
+}
@@ -0,0 +1,149 @@
+/*! \file  rx-fsm-flat_combining.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-flat_combining.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+thread_local const flat_combiner::combining_scope* flat_combiner::combining = nullptr;
+
+flat_combiner::combining_scope::combining_scope(const flat_combiner* c)
+    : combiner(c)
+    , outer(combining)
+{
+    combining = this;
+}
+
+flat_combiner::combining_scope::~combining_scope()
+{
+    combining = outer;
+}
+
+namespace {
+
+std::size_t home_slot()
+{
+    static thread_local std::size_t home = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return home;
+}
+
+}
+
+flat_combiner::flat_combiner()
+{
+    for(auto& s : slots)
+    {
+        s.state.store(empty);
+        s.fn = nullptr;
+        s.context = nullptr;
+    }
+}
+
+bool flat_combiner::is_combining() const
+{
+    for(auto s = combining; s; s = s->outer)
+    {
+        if (s->combiner == this) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void flat_combiner::execute(void (*fn)(void*), void* context)
+{
+    // claim a publication slot, starting at the one of this thread
+    auto i = home_slot() % slot_count;
+    slot* s(nullptr);
+    for(std::size_t n = 1;; ++n)
+    {
+        int expected(empty);
+        if (slots[i].state.compare_exchange_weak(expected, claimed)) {
+            s = &slots[i];
+            break;
+        }
+        i = (i + 1) % slot_count;
+        if (n % slot_count == 0) {
+            std::this_thread::yield();
+        }
+    }
+    s->fn = fn;
+    s->context = context;
+    s->state.store(published);
+    while (s->state.load() != done)
+    {
+        std::unique_lock<std::mutex> guard(lock, std::try_to_lock);
+        if (guard.owns_lock()) {
+            combine();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    // the context points into the caller's frame, i.e. the slot is only released once it is done
+    auto error = s->error;
+    s->error = nullptr;
+    s->state.store(empty);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void flat_combiner::combine()
+{
+    combining_scope scope(this);
+    bool found(true);
+    for(int pass = 0; found && pass < max_passes; ++pass)
+    {
+        found = false;
+        for(auto& s : slots)
+        {
+            if (s.state.load() != published) {
+                continue;
+            }
+            found = true;
+            try {
+                s.fn(s.context);
+            } catch (...) {
+                s.error = std::current_exception();
+            }
+            // the work deferred by the slot's work belongs to the slot, i.e. so do its errors
+            while (!deferred.empty())
+            {
+                auto f = std::move(deferred.front());
+                deferred.pop_front();
+                try {
+                    f();
+                } catch (...) {
+                    if (!s.error) {
+                        s.error = std::current_exception();
+                    }
+                }
+            }
+            s.state.store(done);
+        }
+    }
+}
+
+}
+
+flat_combining::flat_combining()
+    : identity_one_worker(rxsc::make_immediate())
+    , combiner_(std::make_shared<detail::flat_combiner>())
+{
+}
+
+flat_combining make_flat_combining()
+{
+    return flat_combining();
+}
+
+}
+}
@@ -0,0 +1,355 @@
+/*! \file  rx-fsm-metrics.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include <algorithm>
+
+#include "rxcpp/fsm/rx-fsm-metrics.hpp"
+#include "rxcpp/fsm/rx-fsm-predef.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace {
+
+std::size_t bucket_of(std::uint64_t duration)
+{
+#if defined(__GNUC__)
+    auto b = duration ? static_cast<std::size_t>(64 - __builtin_clzll(duration)) : 0;
+#else
+    std::size_t b(0);
+    while (duration)
+    {
+        ++b;
+        duration >>= 1;
+    }
+#endif
+    return std::min(b, duration_histogram::bucket_count - 1);
+}
+
+// a thread may migrate between cores while updating a shard, i.e. the counters need read-modify-write, which is
+// uncontended unless it does
+void increment(std::atomic<std::uint64_t>& counter, std::uint64_t value = 1)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+template<class Cells>
+Cells& cells_of(std::atomic<Cells*>& slot)
+{
+    auto c = slot.load(std::memory_order_acquire);
+    if (!c) {
+        auto created = new Cells();
+        if (slot.compare_exchange_strong(c, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            c = created;
+        } else {
+            delete created;
+        }
+    }
+    return *c;
+}
+
+void record(detail::metrics_delegate::histogram_cells& h, std::uint64_t start, std::uint64_t end)
+{
+    auto duration = end > start ? end - start : 0;
+    increment(h.buckets[bucket_of(duration)]);
+    increment(h.total, duration);
+}
+
+}
+
+const std::size_t duration_histogram::bucket_count;
+
+duration_histogram::duration_histogram()
+    : total(0)
+{
+    buckets.fill(0);
+}
+
+std::uint64_t duration_histogram::count() const
+{
+    std::uint64_t n(0);
+    for(auto b : buckets)
+    {
+        n += b;
+    }
+    return n;
+}
+
+std::uint64_t duration_histogram::sum() const
+{
+    return total;
+}
+
+double duration_histogram::mean() const
+{
+    auto n = count();
+    return n ? static_cast<double>(total) / n : 0;
+}
+
+std::uint64_t duration_histogram::bucket(std::size_t i) const
+{
+    return buckets.at(i);
+}
+
+std::uint64_t duration_histogram::upper_bound(std::size_t i)
+{
+    if (i == 0) {
+        return 0;
+    }
+    return i + 1 >= bucket_count ? ~std::uint64_t(0) : (std::uint64_t(1) << i) - 1;
+}
+
+std::uint64_t duration_histogram::percentile(double p) const
+{
+    auto n = count();
+    if (n == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(p / 100.0 * n + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    std::uint64_t seen(0);
+    for(std::size_t i = 0; i < bucket_count; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return upper_bound(i);
+        }
+    }
+    return upper_bound(bucket_count - 1);
+}
+
+namespace detail {
+
+metrics_delegate::shard::shard(std::size_t s, std::size_t t)
+    : ignored(0)
+    , states(new std::atomic<state_cells*>[s])
+    , transitions(new std::atomic<transition_cells*>[t])
+    , state_count(s)
+    , transition_count(t)
+{
+    for(std::size_t i = 0; i < state_count; ++i)
+    {
+        states[i].store(nullptr, std::memory_order_relaxed);
+    }
+    for(std::size_t i = 0; i < transition_count; ++i)
+    {
+        transitions[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+metrics_delegate::shard::~shard()
+{
+    for(std::size_t i = 0; i < state_count; ++i)
+    {
+        delete states[i].load(std::memory_order_relaxed);
+    }
+    for(std::size_t i = 0; i < transition_count; ++i)
+    {
+        delete transitions[i].load(std::memory_order_relaxed);
+    }
+}
+
+metrics_delegate::state_cells& metrics_delegate::shard::state(std::size_t i)
+{
+    return cells_of(states[i]);
+}
+
+metrics_delegate::transition_cells& metrics_delegate::shard::transition(std::size_t i)
+{
+    return cells_of(transitions[i]);
+}
+
+metrics_delegate::metrics_delegate()
+    : ready(false)
+    , shard_count(std::max<std::size_t>(1, std::thread::hardware_concurrency()))
+{
+    shards.reset(new std::atomic<shard*>[shard_count]);
+    for(std::size_t i = 0; i < shard_count; ++i)
+    {
+        shards[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+metrics_delegate::~metrics_delegate()
+{
+    for(std::size_t i = 0; i < shard_count; ++i)
+    {
+        delete shards[i].load(std::memory_order_relaxed);
+    }
+}
+
+metrics_delegate::shard& metrics_delegate::local()
+{
+    auto& slot = shards[current_core() % shard_count];
+    auto s = slot.load(std::memory_order_acquire);
+    if (!s) {
+        auto created = new shard(state_names.size(), transition_names.size());
+        if (slot.compare_exchange_strong(s, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            s = created;
+        } else {
+            delete created;
+        }
+    }
+    return *s;
+}
+
+void metrics_delegate::add(duration_histogram& h, const histogram_cells& cells)
+{
+    for(std::size_t i = 0; i < duration_histogram::bucket_count; ++i)
+    {
+        h.buckets[i] += cells.buckets[i].load(std::memory_order_relaxed);
+    }
+    h.total += cells.total.load(std::memory_order_relaxed);
+}
+
+fsm::metrics metrics_delegate::snapshot() const
+{
+    fsm::metrics m;
+    m.ignored = 0;
+    if (!ready.load(std::memory_order_acquire)) {
+        return m;
+    }
+    m.name = name;
+    m.states.resize(state_names.size());
+    for(std::size_t i = 0; i < state_names.size(); ++i)
+    {
+        auto& s = m.states[i];
+        s.name = state_names[i];
+        s.entered = s.exited = s.unhandled = 0;
+    }
+    m.transitions.resize(transition_names.size());
+    for(std::size_t i = 0; i < transition_names.size(); ++i)
+    {
+        auto& t = m.transitions[i];
+        t.name = transition_names[i];
+        t.source = transition_sources[i];
+        t.triggered = triggers[i];
+        t.timeout = timeouts[i];
+        t.fired = t.guard_passed = t.guard_failed = 0;
+    }
+    for(std::size_t j = 0; j < shard_count; ++j)
+    {
+        auto sh = shards[j].load(std::memory_order_acquire);
+        if (!sh) {
+            continue;
+        }
+        m.ignored += sh->ignored.load(std::memory_order_relaxed);
+        for(std::size_t i = 0; i < m.states.size(); ++i)
+        {
+            auto cells = sh->states[i].load(std::memory_order_acquire);
+            if (!cells) {
+                continue;
+            }
+            auto& s = m.states[i];
+            const auto& c = *cells;
+            s.entered += c.entered.load(std::memory_order_relaxed);
+            s.exited += c.exited.load(std::memory_order_relaxed);
+            s.unhandled += c.unhandled.load(std::memory_order_relaxed);
+            add(s.entry, c.entry);
+            add(s.exit, c.exit);
+            add(s.dwell, c.dwell);
+        }
+        for(std::size_t i = 0; i < m.transitions.size(); ++i)
+        {
+            auto cells = sh->transitions[i].load(std::memory_order_acquire);
+            if (!cells) {
+                continue;
+            }
+            auto& t = m.transitions[i];
+            const auto& c = *cells;
+            t.fired += c.fired.load(std::memory_order_relaxed);
+            t.guard_passed += c.guard_passed.load(std::memory_order_relaxed);
+            t.guard_failed += c.guard_failed.load(std::memory_order_relaxed);
+            add(t.action, c.action);
+            add(t.guard, c.guard);
+        }
+    }
+    return m;
+}
+
+void metrics_delegate::assembled(std::uint32_t, const std::string& n, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions)
+{
+    name = n;
+    state_names = vertices;
+    transition_names = transitions;
+    // the kinds and sources are set by the state machine before, see state_machine_delegate::trace_assembled
+    transition_sources.resize(transitions.size(), 0);
+    triggers.resize(transitions.size(), false);
+    timeouts.resize(transitions.size(), false);
+    ready.store(true, std::memory_order_release);
+}
+
+void metrics_delegate::guard_evaluated(std::uint32_t, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed)
+{
+    auto& t = local().transition(transition);
+    increment(passed ? t.guard_passed : t.guard_failed);
+    record(t.guard, start, end);
+}
+
+void metrics_delegate::action_executed(std::uint32_t, std::uint64_t start, std::uint64_t end, std::uint32_t transition)
+{
+    auto& t = local().transition(transition);
+    increment(t.fired);
+    record(t.action, start, end);
+}
+
+void metrics_delegate::state_entered(std::uint32_t, std::uint64_t start, std::uint64_t end, std::uint32_t state)
+{
+    auto& s = local().state(state);
+    increment(s.entered);
+    record(s.entry, start, end);
+}
+
+void metrics_delegate::state_exited(std::uint32_t, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered)
+{
+    auto& s = local().state(state);
+    increment(s.exited);
+    record(s.exit, start, end);
+    if (entered) {
+        record(s.dwell, entered, end);
+    }
+}
+
+void metrics_delegate::event_ignored(std::uint32_t, std::uint64_t, std::uint64_t)
+{
+    increment(local().ignored);
+}
+
+void metrics_delegate::event_unhandled(std::uint32_t, std::uint64_t, std::uint32_t state)
+{
+    increment(local().state(state).unhandled);
+}
+
+}
+
+const state_metrics* metrics::find_state(const std::string& n) const
+{
+    for(const auto& s : states)
+    {
+        if (s.name == n) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+const transition_metrics* metrics::find_transition(const std::string& n) const
+{
+    for(const auto& t : transitions)
+    {
+        if (t.name == n) {
+            return &t;
+        }
+    }
+    return nullptr;
+}
+
+}
+}
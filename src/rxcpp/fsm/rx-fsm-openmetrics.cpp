@@ -0,0 +1,596 @@
+/*! \file  rx-fsm-openmetrics.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "rxcpp/fsm/rx-fsm-openmetrics.hpp"
+#include "rxcpp/fsm/rx-fsm-state_machine.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+// the rendered buckets of the dwell histograms, every third power of two from 1.024 us to 137 s
+const std::size_t first_bucket = 10;
+const std::size_t last_bucket = 37;
+const std::size_t bucket_step = 3;
+
+struct histogram_sum
+{
+    std::array<std::uint64_t, duration_histogram::bucket_count> buckets;
+    std::uint64_t total;
+
+    histogram_sum()
+        : total(0)
+    {
+        buckets.fill(0);
+    }
+
+    void add(const duration_histogram& h)
+    {
+        for(std::size_t i = 0; i < duration_histogram::bucket_count; ++i)
+        {
+            buckets[i] += h.bucket(i);
+        }
+        total += h.sum();
+    }
+};
+
+struct state_sum
+{
+    std::uint64_t active;
+    std::uint64_t unhandled;
+    std::uint64_t subscriptions;
+    // pseudostates are never entered, i.e. have neither active instances nor dwell times
+    bool entered;
+    bool triggered;
+    histogram_sum dwell;
+
+    state_sum()
+        : active(0)
+        , unhandled(0)
+        , subscriptions(0)
+        , entered(false)
+        , triggered(false)
+    {
+    }
+};
+
+struct transition_sum
+{
+    std::uint64_t fired;
+    std::uint64_t cancelled;
+    bool timeout;
+
+    transition_sum()
+        : fired(0)
+        , cancelled(0)
+        , timeout(false)
+    {
+    }
+};
+
+struct instance_sum
+{
+    std::size_t number;
+    std::uint64_t fired;
+    std::uint64_t active;
+    std::uint64_t subscriptions;
+};
+
+// the instances of a definition, aggregated by hierarchical name since instances may differ in layout
+struct definition_sum
+{
+    std::size_t instances;
+    std::uint64_t ignored;
+    std::map<std::string, state_sum> states;
+    std::map<std::string, transition_sum> transitions;
+    std::vector<instance_sum> rendered;
+
+    definition_sum()
+        : instances(0)
+        , ignored(0)
+    {
+    }
+};
+
+}
+
+// the sums of the instances no longer alive, immutable once published, since rendering reads them unlocked
+struct openmetrics_delegate::retired_sum
+{
+    definition_sum sum;
+};
+
+namespace {
+
+std::uint64_t difference(std::uint64_t a, std::uint64_t b)
+{
+    return a > b ? a - b : 0;
+}
+
+void append_escaped(std::string& out, const std::string& value)
+{
+    for(auto c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            out += c;
+        }
+    }
+}
+
+void append_seconds(std::string& out, std::uint64_t ns)
+{
+    char s[32];
+    std::snprintf(s, sizeof(s), "%.12g", static_cast<double>(ns) / 1e9);
+    out += s;
+}
+
+void append_family(std::string& out, const char* name, const char* type, const char* help, const char* unit = nullptr)
+{
+    out += "# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+    if (unit) {
+        out += "# UNIT ";
+        out += name;
+        out += ' ';
+        out += unit;
+        out += '\n';
+    }
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += '\n';
+}
+
+// appends a sample, the labels are pairs of names and values
+void append_sample(std::string& out, const char* name, const char* suffix, std::initializer_list<std::pair<const char*, const std::string*>> labels, const std::string& value)
+{
+    out += name;
+    out += suffix;
+    auto separator = '{';
+    for(const auto& l : labels)
+    {
+        out += separator;
+        out += l.first;
+        out += "=\"";
+        append_escaped(out, *l.second);
+        out += '"';
+        separator = ',';
+    }
+    if (separator == ',') {
+        out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+// adds the counters of an instance to the sums of its definition
+instance_sum accumulate(definition_sum& sum, const openmetrics_delegate::instance& i)
+{
+    auto m = i.metering->snapshot();
+    // the states of a state machine no longer alive are not active
+    auto alive = !i.machine.expired();
+    std::vector<std::uint64_t> active(m.states.size(), 0), triggers(m.states.size(), 0);
+    for(const auto& t : m.transitions)
+    {
+        if (t.triggered && t.source < triggers.size()) {
+            ++triggers[t.source];
+        }
+    }
+    instance_sum is = {i.number, 0, 0, 0};
+    sum.ignored += m.ignored;
+    for(std::size_t v = 0; v < m.states.size(); ++v)
+    {
+        const auto& s = m.states[v];
+        if (alive) {
+            active[v] = difference(s.entered, s.exited);
+        }
+        auto& ss = sum.states[s.name];
+        ss.active += active[v];
+        ss.unhandled += s.unhandled;
+        ss.subscriptions += active[v] * triggers[v];
+        ss.entered = ss.entered || s.entered != 0;
+        ss.triggered = ss.triggered || triggers[v] != 0;
+        ss.dwell.add(s.dwell);
+        is.active += active[v];
+        is.subscriptions += active[v] * triggers[v];
+    }
+    for(const auto& t : m.transitions)
+    {
+        auto& ts = sum.transitions[t.name];
+        ts.fired += t.fired;
+        ts.timeout = t.timeout;
+        if (t.timeout && t.source < m.states.size()) {
+            // armed on every entry of the source, and either fired, still armed or cancelled
+            ts.cancelled += difference(m.states[t.source].entered, t.fired + active[t.source]);
+        }
+        is.fired += t.fired;
+    }
+    return is;
+}
+
+definition_sum aggregate(const openmetrics_delegate::definition& d, std::size_t max_instances)
+{
+    definition_sum sum;
+    if (d.retired) {
+        sum = d.retired->sum;
+    }
+    sum.instances = d.instances.size();
+    for(const auto& i : d.instances)
+    {
+        auto is = accumulate(sum, i);
+        if (sum.rendered.size() < max_instances) {
+            sum.rendered.push_back(is);
+        }
+    }
+    return sum;
+}
+
+}
+
+void openmetrics_delegate::retire_expired(definition& d)
+{
+    auto expired = std::stable_partition(d.instances.begin(), d.instances.end(), [](const instance& i) {
+        return !i.machine.expired();
+    });
+    if (expired == d.instances.end()) {
+        return;
+    }
+    auto r = std::make_shared<retired_sum>();
+    if (d.retired) {
+        r->sum = d.retired->sum;
+    }
+    for(auto it = expired; it != d.instances.end(); ++it)
+    {
+        accumulate(r->sum, *it);
+    }
+    d.retired = std::move(r);
+    d.instances.erase(expired, d.instances.end());
+}
+
+openmetrics_delegate::openmetrics_delegate(std::size_t m)
+    : max_instances(m)
+{
+}
+
+void openmetrics_delegate::add(const state_machine& sm, const std::string& definition_name)
+{
+    const auto& machine = sm();
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = definitions.begin();
+    while (it != definitions.end() && it->name != definition_name)
+    {
+        ++it;
+    }
+    if (it == definitions.end()) {
+        definitions.push_back(definition{definition_name, {}, 0, nullptr});
+        it = definitions.end() - 1;
+    }
+    retire_expired(*it);
+    for(const auto& i : it->instances)
+    {
+        if (i.metering == machine->metering) {
+            return;
+        }
+    }
+    it->instances.push_back(instance{machine, machine->metering, it->registered++});
+}
+
+void openmetrics_delegate::add(const sharded_runtime& rt, const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    runtimes.push_back(runtime{name, rt});
+}
+
+void openmetrics_delegate::render(std::string& out) const
+{
+    std::vector<definition> ds;
+    std::vector<runtime> rs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(auto& d : definitions)
+        {
+            retire_expired(d);
+        }
+        ds = definitions;
+        rs = runtimes;
+    }
+    std::vector<definition_sum> sums;
+    sums.reserve(ds.size());
+    for(const auto& d : ds)
+    {
+        sums.push_back(aggregate(d, max_instances));
+    }
+    const char* name;
+    auto for_each_definition = [&ds, &sums](const std::function<void(const std::string&, const definition_sum&)>& f) {
+        for(std::size_t i = 0; i < ds.size(); ++i)
+        {
+            f(ds[i].name, sums[i]);
+        }
+    };
+
+    name = "rxcpp_fsm_instances";
+    append_family(out, name, "gauge", "Number of registered state machines of the definition alive.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        append_sample(out, name, "", {{"definition", &d}}, std::to_string(s.instances));
+    });
+
+    name = "rxcpp_fsm_transitions";
+    append_family(out, name, "counter", "Number of times the transition fired.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& t : s.transitions)
+        {
+            append_sample(out, name, "_total", {{"definition", &d}, {"transition", &t.first}}, std::to_string(t.second.fired));
+        }
+    });
+
+    name = "rxcpp_fsm_timeout_fires";
+    append_family(out, name, "counter", "Number of times the timeout transition fired.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& t : s.transitions)
+        {
+            if (t.second.timeout) {
+                append_sample(out, name, "_total", {{"definition", &d}, {"transition", &t.first}}, std::to_string(t.second.fired));
+            }
+        }
+    });
+
+    name = "rxcpp_fsm_timeout_cancels";
+    append_family(out, name, "counter", "Number of times the timeout transition was armed, but its source left by another transition.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& t : s.transitions)
+        {
+            if (t.second.timeout) {
+                append_sample(out, name, "_total", {{"definition", &d}, {"transition", &t.first}}, std::to_string(t.second.cancelled));
+            }
+        }
+    });
+
+    name = "rxcpp_fsm_active_states";
+    append_family(out, name, "gauge", "Number of instances the state is active in.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& v : s.states)
+        {
+            if (v.second.entered) {
+                append_sample(out, name, "", {{"definition", &d}, {"state", &v.first}}, std::to_string(v.second.active));
+            }
+        }
+    });
+
+    name = "rxcpp_fsm_state_dwell_seconds";
+    append_family(out, name, "histogram", "Time from the entry until the exit of the state.", "seconds");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& v : s.states)
+        {
+            if (!v.second.entered) {
+                continue;
+            }
+            const auto& h = v.second.dwell;
+            std::uint64_t count(0);
+            std::size_t b(0);
+            for(auto upper = first_bucket; upper <= last_bucket; upper += bucket_step)
+            {
+                // bucket i counts durations below 2^i ns
+                for(; b <= upper; ++b)
+                {
+                    count += h.buckets[b];
+                }
+                std::string le;
+                append_seconds(le, std::uint64_t(1) << upper);
+                append_sample(out, name, "_bucket", {{"definition", &d}, {"state", &v.first}, {"le", &le}}, std::to_string(count));
+            }
+            for(; b < duration_histogram::bucket_count; ++b)
+            {
+                count += h.buckets[b];
+            }
+            static const std::string infinity("+Inf");
+            append_sample(out, name, "_bucket", {{"definition", &d}, {"state", &v.first}, {"le", &infinity}}, std::to_string(count));
+            append_sample(out, name, "_count", {{"definition", &d}, {"state", &v.first}}, std::to_string(count));
+            std::string total;
+            append_seconds(total, h.total);
+            append_sample(out, name, "_sum", {{"definition", &d}, {"state", &v.first}}, total);
+        }
+    });
+
+    name = "rxcpp_fsm_unhandled_events";
+    append_family(out, name, "counter", "Number of times a trigger of the state emitted, but the guards of all its transitions failed.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& v : s.states)
+        {
+            if (v.second.triggered) {
+                append_sample(out, name, "_total", {{"definition", &d}, {"state", &v.first}}, std::to_string(v.second.unhandled));
+            }
+        }
+    });
+
+    name = "rxcpp_fsm_ignored_events";
+    append_family(out, name, "counter", "Number of events fired that no active state had a transition for.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        append_sample(out, name, "_total", {{"definition", &d}}, std::to_string(s.ignored));
+    });
+
+    name = "rxcpp_fsm_live_subscriptions";
+    append_family(out, name, "gauge", "Number of trigger subscriptions of the active states.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        std::uint64_t n(0);
+        for(const auto& v : s.states)
+        {
+            n += v.second.subscriptions;
+        }
+        append_sample(out, name, "", {{"definition", &d}}, std::to_string(n));
+    });
+
+    name = "rxcpp_fsm_instance_transitions";
+    append_family(out, name, "counter", "Number of transitions fired by the instance.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& i : s.rendered)
+        {
+            auto number = std::to_string(i.number);
+            append_sample(out, name, "_total", {{"definition", &d}, {"instance", &number}}, std::to_string(i.fired));
+        }
+    });
+
+    name = "rxcpp_fsm_instance_active_states";
+    append_family(out, name, "gauge", "Number of active states of the instance.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& i : s.rendered)
+        {
+            auto number = std::to_string(i.number);
+            append_sample(out, name, "", {{"definition", &d}, {"instance", &number}}, std::to_string(i.active));
+        }
+    });
+
+    name = "rxcpp_fsm_instance_live_subscriptions";
+    append_family(out, name, "gauge", "Number of trigger subscriptions of the active states of the instance.");
+    for_each_definition([&](const std::string& d, const definition_sum& s) {
+        for(const auto& i : s.rendered)
+        {
+            auto number = std::to_string(i.number);
+            append_sample(out, name, "", {{"definition", &d}, {"instance", &number}}, std::to_string(i.subscriptions));
+        }
+    });
+
+    // the counters of a shard are read one by one, i.e. the depth is approximate
+    std::vector<std::vector<shard_stats>> stats;
+    stats.reserve(rs.size());
+    for(const auto& r : rs)
+    {
+        stats.emplace_back();
+        for(std::size_t i = 0; i < r.shards.size(); ++i)
+        {
+            stats.back().push_back(r.shards.stats(i));
+        }
+    }
+    auto for_each_shard = [&rs, &stats](const std::function<void(const std::string&, const std::string&, const shard_stats&)>& f) {
+        for(std::size_t r = 0; r < rs.size(); ++r)
+        {
+            for(std::size_t i = 0; i < stats[r].size(); ++i)
+            {
+                f(rs[r].name, std::to_string(i), stats[r][i]);
+            }
+        }
+    };
+
+    name = "rxcpp_fsm_shard_queue_depth";
+    append_family(out, name, "gauge", "Number of actions posted to the shard but not yet executed.");
+    for_each_shard([&](const std::string& r, const std::string& i, const shard_stats& s) {
+        append_sample(out, name, "", {{"runtime", &r}, {"shard", &i}}, std::to_string(difference(s.local_posts + s.ring_posts + s.inbox_posts, s.executed)));
+    });
+
+    name = "rxcpp_fsm_shard_executed";
+    append_family(out, name, "counter", "Number of actions executed by the shard.");
+    for_each_shard([&](const std::string& r, const std::string& i, const shard_stats& s) {
+        append_sample(out, name, "_total", {{"runtime", &r}, {"shard", &i}}, std::to_string(s.executed));
+    });
+
+    out += "# EOF\n";
+}
+
+}
+
+openmetrics_exporter::openmetrics_exporter(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+openmetrics_exporter& openmetrics_exporter::with_state_machine(state_machine& sm)
+{
+    return with_state_machine(sm, sm.name());
+}
+
+openmetrics_exporter& openmetrics_exporter::with_state_machine(state_machine& sm, const std::string& definition)
+{
+    if (!sm()->metering) {
+        sm.with_metrics();
+    }
+    delegate->add(sm, definition);
+    return *this;
+}
+
+openmetrics_exporter& openmetrics_exporter::with_sharded_runtime(const sharded_runtime& rt, const std::string& name)
+{
+    delegate->add(rt, name);
+    return *this;
+}
+
+void openmetrics_exporter::write(std::string& out) const
+{
+    delegate->render(out);
+}
+
+void openmetrics_exporter::write(int fd) const
+{
+    std::string text;
+    delegate->render(text);
+    auto p = text.data();
+    auto remaining = text.size();
+    while (remaining)
+    {
+#if defined(_WIN32)
+        auto n = ::_write(fd, p, static_cast<unsigned>(remaining));
+#else
+        auto n = ::write(fd, p, remaining);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "cannot write metrics");
+        }
+        p += n;
+        remaining -= static_cast<std::size_t>(n);
+    }
+}
+
+std::string openmetrics_exporter::to_string() const
+{
+    std::string text;
+    delegate->render(text);
+    return text;
+}
+
+openmetrics_exporter make_openmetrics_exporter(std::size_t max_instances)
+{
+    return openmetrics_exporter(std::make_shared<openmetrics_exporter::delegate_type>(max_instances));
+}
+
+}
+}
@@ -0,0 +1,94 @@
+/*! \file  rx-fsm-pool.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-pool.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+const std::size_t blocks_per_chunk = 32;
+
+std::size_t aligned_size(std::size_t size)
+{
+    const std::size_t alignment = alignof(std::max_align_t);
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void* node_pool::allocate(std::size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (block_size == 0) {
+        block_size = aligned_size(size < sizeof(free_block) ? sizeof(free_block) : size);
+    }
+    if (aligned_size(size) > block_size) {
+        return ::operator new(size);
+    }
+    if (!free_list) {
+        auto chunk = static_cast<char*>(::operator new(block_size * blocks_per_chunk));
+        chunks.push_back(chunk);
+        for(std::size_t i = blocks_per_chunk; i > 0; --i)
+        {
+            auto block = reinterpret_cast<free_block*>(chunk + (i - 1) * block_size);
+            block->next = free_list;
+            free_list = block;
+        }
+        counters.allocated += blocks_per_chunk;
+    }
+    auto block = free_list;
+    free_list = block->next;
+    if (++counters.in_use > counters.high_water_mark) {
+        counters.high_water_mark = counters.in_use;
+    }
+    return block;
+}
+
+void node_pool::deallocate(void* p, std::size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (aligned_size(size) > block_size) {
+        ::operator delete(p);
+        return;
+    }
+    auto block = static_cast<free_block*>(p);
+    block->next = free_list;
+    free_list = block;
+    --counters.in_use;
+}
+
+node_pool_stats node_pool::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return counters;
+}
+
+node_pool::node_pool()
+    : block_size(0)
+    , free_list(nullptr)
+{
+    counters.allocated = 0;
+    counters.in_use = 0;
+    counters.high_water_mark = 0;
+}
+
+node_pool::~node_pool()
+{
+    for(auto chunk : chunks)
+    {
+        ::operator delete(chunk);
+    }
+}
+
+}
+}
+}
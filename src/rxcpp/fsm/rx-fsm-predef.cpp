@@ -8,34 +8,57 @@
 #include "rxcpp/fsm/rx-fsm-predef.hpp"
 #include "rxcpp/fsm/rx-fsm-state_machine.hpp"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace rxcpp {
 
 namespace fsm {
 
 namespace detail {
 
+std::shared_ptr<const state_machine_delegate> element_delegate::root() const
+{
+    if (assembled_.load(std::memory_order_acquire)) {
+        return root_.lock();
+    }
+    // being built, i.e. the owners may still change
+    auto o = this->owner<element_delegate>();
+    if (!o) {
+        auto sm = dynamic_cast<const state_machine_delegate*>(this);
+        if (sm) {
+            return sm->shared_from_this();
+        }
+        return std::shared_ptr<const state_machine_delegate>();
+    }
+    auto p = o->owner<element_delegate>();
+    while (p)
+    {
+        o = p;
+        p = o->owner<element_delegate>();
+    }
+    return std::dynamic_pointer_cast<const state_machine_delegate>(o);
+}
+
+void element_delegate::freeze_root(const std::shared_ptr<const state_machine_delegate>& sm)
+{
+    root_ = sm;
+    assembled_.store(true, std::memory_order_release);
+}
+
 std::shared_ptr<const state_machine_delegate> element_delegate::state_machine() const
 {
-   auto o = this->owner<element_delegate>();
-   if (!o) {
-       const auto* sm = dynamic_cast<const state_machine_delegate*>(this);
-       if (sm) {
-           return sm->shared_from_this();
-       }
-       return std::shared_ptr<const state_machine_delegate>();
-   }
-   auto p = o->owner<element_delegate>();
-   while (p)
-   {
-       o = p;
-       p = o->owner<element_delegate>();
-   }
-   return std::dynamic_pointer_cast<const state_machine_delegate>(o);
+    return root();
 }
 
 bool element_delegate::is_assembled() const
 {
-    auto sm = state_machine();
+    if (assembled_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    auto sm = root();
     if (sm) {
         return sm->assembled.load();
     }
@@ -45,18 +68,25 @@ bool element_delegate::is_assembled() const
 element_delegate::element_delegate(std::string n, const std::shared_ptr<this_type>& o)
     : name(std::move(n))
     , owner_(o)
+    , assembled_(false)
 {
 }
 
 element_delegate::element_delegate(std::string n)
     : name(std::move(n))
+    , assembled_(false)
+{
+}
+
+element_delegate::element_delegate()
+    : assembled_(false)
 {
 }
 
 std::string element_delegate::exception_prefix() const
 {
     std::ostringstream s;
-    auto sm = state_machine();
+    auto sm = root();
     if (sm) {
         s << "In state machine '" << sm->name << "': ";
     }
@@ -69,6 +99,30 @@ internal_error::internal_error(const std::string& msg)
 {
 }
 
+void pin_current_thread(std::size_t core)
+{
+#if defined(__linux__)
+    auto cores = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<int>(core % cores), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+std::size_t current_core()
+{
+#if defined(__linux__)
+    auto core = sched_getcpu();
+    if (core >= 0) {
+        return static_cast<std::size_t>(core);
+    }
+#endif
+    return std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
 }
 
 not_allowed::not_allowed(const std::string& msg)
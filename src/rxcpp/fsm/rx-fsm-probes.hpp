@@ -0,0 +1,25 @@
+/*! \file  rx-fsm-probes.hpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+#pragma once
+
+#if !defined(RX_FSM_PROBES_HPP)
+#define RX_FSM_PROBES_HPP
+
+#include "rxcpp/fsm/rx-fsm-tracer.hpp"
+
+/*  Fires the USDT probes declared in rx-fsm-tracer.hpp. Private to the library, since sys/sdt.h is only required, and
+    its configuration only applies, where the probes are compiled in.
+ */
+#if defined(RXCPP_FSM_USDT)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define RX_FSM_PROBE(name, ...) STAP_PROBEV(rxcpp_fsm, name, __VA_ARGS__)
+#else
+#define RX_FSM_PROBE(name, ...) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,344 @@
+/*! \file  rx-fsm-sharded_runtime.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-sharded_runtime.hpp"
+
+#include "rxcpp/fsm/rx-fsm-run_loop.hpp"
+
+#include <future>
+#include <thread>
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+// bounded single producer single consumer ring
+class shard_ring
+{
+public:
+
+    static const std::size_t capacity = 256;
+
+    shard_ring()
+        : head(0)
+        , tail(0)
+    {
+    }
+
+    ~shard_ring()
+    {
+        while (pop([](run_loop_item&&) {}))
+        {
+        }
+    }
+
+    bool push(run_loop_item&& item)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t - head.load() == capacity) {
+            return false;
+        }
+        new (&slots[t % capacity]) run_loop_item(std::move(item));
+        tail.store(t + 1);
+        return true;
+    }
+
+    template<class F>
+    bool pop(F f)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h == tail.load()) {
+            return false;
+        }
+        auto* item = reinterpret_cast<run_loop_item*>(&slots[h % capacity]);
+        f(std::move(*item));
+        item->~run_loop_item();
+        head.store(h + 1);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load() == tail.load();
+    }
+
+private:
+
+    // consumer and producer indices on separate cache lines
+    std::atomic<std::size_t> head;
+    char padding0[64];
+    std::atomic<std::size_t> tail;
+    char padding1[64];
+    typename std::aligned_storage<sizeof(run_loop_item), alignof(run_loop_item)>::type slots[capacity];
+};
+
+struct shard_state;
+
+thread_local shard_state* current_shard = nullptr;
+
+struct shard_state : public run_loop<shard_state, park_when_idle>
+{
+    std::size_t index;
+    std::vector<shard_state*> peers;
+    // inbound rings, one per other shard, allocated by the consuming shard's thread, i.e. on its NUMA node
+    std::vector<std::unique_ptr<shard_ring>> rings;
+    // outbound posts that did not fit in the ring of the target shard, in order, one per target shard
+    std::vector<std::deque<run_loop_item>> overflow;
+    std::size_t overflowing;
+
+    std::atomic<std::uint64_t> local_posts, ring_posts, inbox_posts;
+
+    shard_state(std::size_t i, std::size_t shards)
+        : index(i)
+        , rings(shards)
+        , overflow(shards)
+        , overflowing(0)
+        , local_posts(0)
+        , ring_posts(0)
+        , inbox_posts(0)
+    {
+        for(std::size_t p = 0; p < shards; ++p)
+        {
+            // posts of the shard's own thread go to local instead
+            if (p != index) {
+                rings[p].reset(new shard_ring());
+            }
+        }
+    }
+
+    void post(run_loop_clock::time_point when, const rxsc::schedulable& what)
+    {
+        run_loop_item item = {when, 0, what};
+        auto* from = current_shard;
+        if (from == this) {
+            post_local(std::move(item));
+            local_posts.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (from && index < from->peers.size() && from->peers[index] == this) {
+            auto& pending = from->overflow[index];
+            if (pending.empty() && rings[from->index]->push(std::move(item))) {
+                ring_posts.fetch_add(1, std::memory_order_relaxed);
+                notify();
+                return;
+            }
+            // keep the order of the posts, the producing shard moves them to the ring as it is drained
+            if (pending.empty()) {
+                ++from->overflowing;
+            }
+            pending.push_back(std::move(item));
+            return;
+        }
+        post_inbox(std::move(item));
+        inbox_posts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // run loop hooks
+
+    void flush_posts()
+    {
+        if (overflowing == 0) {
+            return;
+        }
+        for(std::size_t t = 0; t < overflow.size(); ++t)
+        {
+            auto& pending = overflow[t];
+            if (pending.empty()) {
+                continue;
+            }
+            auto* target = peers[t];
+            auto& ring = *target->rings[index];
+            std::size_t moved(0);
+            while (!pending.empty() && ring.push(std::move(pending.front())))
+            {
+                pending.pop_front();
+                ++moved;
+            }
+            if (moved > 0) {
+                target->ring_posts.fetch_add(moved, std::memory_order_relaxed);
+                target->notify();
+            }
+            if (pending.empty()) {
+                --overflowing;
+            }
+        }
+    }
+
+    template<class F>
+    void drain_posts(F&& sort)
+    {
+        for(auto& ring : rings)
+        {
+            if (ring) {
+                while (ring->pop(sort))
+                {
+                }
+            }
+        }
+    }
+
+    bool has_posts() const
+    {
+        for(const auto& ring : rings)
+        {
+            if (ring && !ring->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    run_loop_clock::time_point retry_at() const
+    {
+        if (overflowing > 0) {
+            // retry moving the overflow when the target shards have drained their rings
+            return run_loop_clock::now() + std::chrono::microseconds(100);
+        }
+        return run_loop_clock::time_point::max();
+    }
+
+    void discard_posts()
+    {
+        for(auto& pending : overflow)
+        {
+            pending.clear();
+        }
+    }
+};
+
+std::uint64_t mix(std::uint64_t x)
+{
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+}
+
+struct sharded_runtime_delegate
+{
+    std::vector<std::shared_ptr<shard_state>> states;
+    std::vector<rxsc::scheduler> schedulers;
+    std::vector<std::thread> threads;
+
+    sharded_runtime_delegate(std::size_t n, bool pin)
+    {
+        std::vector<std::promise<std::shared_ptr<shard_state>>> created(n);
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            auto* promise = &created[i];
+            threads.emplace_back([promise, i, n, pin]() {
+                if (pin) {
+                    pin_current_thread(i);
+                }
+                // allocated by the shard thread, i.e. on its NUMA node by first touch, including its inbound rings
+                auto state = std::make_shared<shard_state>(i, n);
+                current_shard = state.get();
+                promise->set_value(state);
+                state->loop();
+                current_shard = nullptr;
+            });
+        }
+        for(auto& c : created)
+        {
+            auto state = c.get_future().get();
+            schedulers.push_back(rxsc::make_scheduler<run_loop_scheduler<shard_state>>(state));
+            states.push_back(std::move(state));
+        }
+        // nothing is posted to the shards before the runtime is returned
+        for(auto& s : states)
+        {
+            for(auto& peer : states)
+            {
+                s->peers.push_back(peer.get());
+            }
+        }
+    }
+
+    ~sharded_runtime_delegate()
+    {
+        for(auto& s : states)
+        {
+            s->shutdown();
+        }
+        for(auto& t : threads)
+        {
+            if (t.get_id() == std::this_thread::get_id()) {
+                t.detach();
+            } else {
+                t.join();
+            }
+        }
+    }
+};
+
+}
+
+shard::shard(rxsc::scheduler sc, std::size_t index)
+    : identity_one_worker(std::move(sc))
+    , index_(index)
+{
+}
+
+sharded_runtime::sharded_runtime(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+std::size_t sharded_runtime::size() const
+{
+    return delegate->states.size();
+}
+
+shard sharded_runtime::get_shard(std::size_t index) const
+{
+    if (index >= size()) {
+        throw not_allowed("shard index out of range");
+    }
+    return shard(delegate->schedulers[index], index);
+}
+
+shard sharded_runtime::shard_for(const std::string& key) const
+{
+    return get_shard(static_cast<std::size_t>(detail::mix(std::hash<std::string>()(key)) % size()));
+}
+
+shard sharded_runtime::shard_for(std::uint64_t key) const
+{
+    return get_shard(static_cast<std::size_t>(detail::mix(key) % size()));
+}
+
+shard_stats sharded_runtime::stats(std::size_t index) const
+{
+    if (index >= size()) {
+        throw not_allowed("shard index out of range");
+    }
+    const auto& state = delegate->states[index];
+    shard_stats s;
+    s.executed = state->executed.load();
+    s.local_posts = state->local_posts.load();
+    s.ring_posts = state->ring_posts.load();
+    s.inbox_posts = state->inbox_posts.load();
+    return s;
+}
+
+sharded_runtime make_sharded_runtime(std::size_t shards, bool pin)
+{
+    if (shards == 0) {
+        shards = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    return sharded_runtime(std::make_shared<detail::sharded_runtime_delegate>(shards, pin));
+}
+
+}
+}
@@ -4,8 +4,12 @@
     \author     Mattias Johansson
 */
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
 
 #include "rxcpp/fsm/rx-fsm-state_machine.hpp"
+#include "rx-fsm-probes.hpp"
 
 namespace rxcpp {
 
@@ -30,14 +34,15 @@ void state_machine_delegate::get_join_pseudostates(const std::shared_ptr<virtual
 
 std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::find_common_ancestor(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& target)
 {
-    const auto& ancestors = state_ancestors[target];
+    auto first = ancestors_begin(*target);
+    auto last = ancestors_end(*target);
     auto cur = current;
     while (cur) {
         auto parent = cur->parent.lock();
         if (parent) {
             if (parent->state) {
-                auto it = std::find(ancestors.begin(), ancestors.end(), parent->state);
-                if (it != ancestors.end()) {
+                auto it = std::find(first, last, parent->state);
+                if (it != last) {
                     return cur;
                 }
             } else {
@@ -67,25 +72,53 @@ std::multimap<int, const std::shared_ptr<state_machine_delegate::current_state>>
     return map;
 }
 
-void state_machine_delegate::get_deep_history_recursively(const std::shared_ptr<current_state>& current, std::vector<std::shared_ptr<virtual_vertex_delegate>>& history)
+std::size_t state_machine_delegate::add_history(const std::shared_ptr<pseudostate_delegate>& pseudostate)
+{
+    if (!pseudostate) {
+        return no_index;
+    }
+    history_record history;
+    history.pseudostate = pseudostate;
+    history.size = 0;
+    histories.push_back(std::move(history));
+    return histories.size() - 1;
+}
+
+void state_machine_delegate::generate_history(const std::shared_ptr<virtual_region_delegate>& region)
+{
+    region->shallow_history = add_history(get_pseudostate(pseudostate_kind::shallow_history, region->sub_states));
+    region->deep_history = add_history(get_pseudostate(pseudostate_kind::deep_history, region->sub_states));
+}
+
+state_machine_delegate::history_record* state_machine_delegate::find_history(const std::shared_ptr<pseudostate_delegate>& pseudostate)
+{
+    auto region = region_of(*pseudostate);
+    if (region) {
+        auto index = pseudostate->type == pseudostate_kind::deep_history ? region->deep_history : region->shallow_history;
+        if (index != no_index && histories[index].pseudostate == pseudostate) {
+            return &histories[index];
+        }
+    }
+    return nullptr;
+}
+
+void state_machine_delegate::record_deep_history(const std::shared_ptr<current_state>& current, history_record& history)
 {
     if (current->state) {
         if (current->children.empty()) {
-            history.push_back(current->state);
+            history.push_back(current->state->id);
         } else {
             for(const auto& child : current->children)
             {
-                get_deep_history_recursively(child, history);
+                record_deep_history(child, history);
             }
         }
     }
 }
 
-std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::get_deep_history(const std::shared_ptr<current_state>& current)
+std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::make_current_state()
 {
-    std::vector<std::shared_ptr<virtual_vertex_delegate>> history;
-    get_deep_history_recursively(current, history);
-    return history;
+    return std::allocate_shared<current_state>(pool_allocator<current_state>(pool));
 }
 
 void state_machine_delegate::exit_region(const std::shared_ptr<current_state>& current)
@@ -99,21 +132,57 @@ void state_machine_delegate::exit_region(const std::shared_ptr<current_state>& c
             cs.unsubscribe();
         }
         parent->children.clear();
+        std::fill(std::begin(parent->regions), std::end(parent->regions), 0);
     } else {
         current->lifetime.unsubscribe();
     }
 }
 
-void state_machine_delegate::exit_state(const std::shared_ptr<current_state>& common, const std::shared_ptr<current_state>& current)
+void state_machine_delegate::add_region(const std::shared_ptr<current_state>& parent, const std::shared_ptr<current_state>& current)
+{
+    current->parent = parent;
+    std::fill(std::begin(current->regions), std::end(current->regions), 0);
+    parent->children.push_back(current);
+    ++parent->regions[current->status];
+}
+
+void state_machine_delegate::set_region_status(const std::shared_ptr<current_state>& current, region_status_type status)
+{
+    auto parent = current->parent.lock();
+    if (parent) {
+        --parent->regions[current->status];
+        ++parent->regions[status];
+    }
+    current->status = status;
+}
+
+void state_machine_delegate::exit_state_actions(const std::shared_ptr<current_state>& current)
 {
     auto s = std::dynamic_pointer_cast<state_delegate>(current->state);
     if (s) {
        if (!current->entered) {
-           s->on_entry();
+           perform([this, s]() {
+               enter_action(*s);
+           });
        }
-       s->on_exit();
+       perform([this, s]() {
+           exit_action(*s);
+       });
        current->entered = false;
     }
+}
+
+void state_machine_delegate::exit_state(const std::shared_ptr<current_state>& common, const std::shared_ptr<current_state>& current)
+{
+    exit_state_actions(current);
+    release_state(common, current);
+}
+
+void state_machine_delegate::release_state(const std::shared_ptr<current_state>& common, const std::shared_ptr<current_state>& current)
+{
+    if (RX_FSM_PROBE_ENABLED(state_exit)) {
+        RX_FSM_PROBE(state_exit, trace_id, name.c_str(), current->state->id, current->state->name.c_str());
+    }
     auto cs = current->state_lifetime;
     current->lifetime.remove(cs.get_weak());
     cs.unsubscribe();
@@ -128,21 +197,46 @@ void state_machine_delegate::exit_states_recursively(const std::shared_ptr<curre
     auto order = determine_exit_order(current);
     for(const auto& o : order)
     {
-        auto r = o.second->region.lock();
+        auto r = o.second->region;
         if (r) {
-            auto deep = get_pseudostate(pseudostate_kind::deep_history, r->sub_states);
-            if (deep) {
-                deep_history_pseudostates[deep] = get_deep_history(o.second);
+            // only regions owning a history pseudostate record their history
+            if (r->deep_history != no_index) {
+                auto& history = histories[r->deep_history];
+                history.clear();
+                record_deep_history(o.second, history);
             }
-            auto shallow = get_pseudostate(pseudostate_kind::shallow_history, r->sub_states);
-            if (shallow) {
-                shallow_history_pseudostates[shallow] = o.second->state;
+            if (r->shallow_history != no_index) {
+                auto& history = histories[r->shallow_history];
+                history.clear();
+                history.push_back(o.second->state->id);
             }
         }
     }
-    for (const auto& o : order)
+    if (!parallel_regions || recorded_actions) {
+        for (const auto& o : order)
+        {
+            exit_state(current, o.second);
+        }
+        return;
+    }
+    // states on the same level are in different orthogonal regions, exit them concurrently
+    for(auto it = order.begin(); it != order.end();)
     {
-        exit_state(current, o.second);
+        auto end = order.upper_bound(it->first);
+        std::vector<std::function<void()>> actions;
+        for(auto o = it; o != end; ++o)
+        {
+            auto c = o->second;
+            actions.push_back([this, c]() {
+                exit_state_actions(c);
+            });
+        }
+        run_parallel(actions);
+        for(auto o = it; o != end; ++o)
+        {
+            release_state(current, o->second);
+        }
+        it = end;
     }
 }
 
@@ -154,9 +248,13 @@ std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::de
         switch (pseudostate->type) {
         case pseudostate_kind::shallow_history:
         {
-            const auto& history_state = shallow_history_pseudostates[pseudostate];
-            if (history_state) {
-                targets.push_back(history_state);
+            auto history = find_history(pseudostate);
+            if (history && history->size > 0) {
+                RX_FSM_TRACE(if (traced()) tracing->history_restored(trace_id, tracer::now(), pseudostate->id, history->size));
+                if (RX_FSM_PROBE_ENABLED(history)) {
+                    RX_FSM_PROBE(history, trace_id, name.c_str(), pseudostate->id, pseudostate->name.c_str(), history->size);
+                }
+                targets.push_back(vertices[(*history)[0]]);
             } else {
                 if (pseudostate->transitions.empty()) {
                     auto region = target->owner<virtual_region_delegate>();
@@ -173,16 +271,26 @@ std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::de
                     if (subscriber.is_subscribed()) {
                         subscriber.on_next(transition(t));
                     }
-                    t->execute_action();
+                    perform([this, t]() {
+                        execute(*t);
+                    });
                 }
             }
             break;
         }
         case pseudostate_kind::deep_history:
         {
-            const auto& history_states = deep_history_pseudostates[pseudostate];
-            if (!history_states.empty()) {
-                return history_states;
+            auto history = find_history(pseudostate);
+            if (history && history->size > 0) {
+                RX_FSM_TRACE(if (traced()) tracing->history_restored(trace_id, tracer::now(), pseudostate->id, history->size));
+                if (RX_FSM_PROBE_ENABLED(history)) {
+                    RX_FSM_PROBE(history, trace_id, name.c_str(), pseudostate->id, pseudostate->name.c_str(), history->size);
+                }
+                for(std::size_t i = 0; i < history->size; ++i)
+                {
+                    targets.push_back(vertices[(*history)[i]]);
+                }
+                return targets;
             }
             if (pseudostate->transitions.empty()) {
                 auto region = target->owner<virtual_region_delegate>();
@@ -199,12 +307,17 @@ std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::de
                 if (subscriber.is_subscribed()) {
                     subscriber.on_next(transition(t));
                 }
-                t->execute_action();
+                perform([this, t]() {
+                    execute(*t);
+                });
             }
             break;
         }
         case pseudostate_kind::fork:
         {
+            if (RX_FSM_PROBE_ENABLED(fork)) {
+                RX_FSM_PROBE(fork, trace_id, name.c_str(), pseudostate->id, pseudostate->name.c_str(), pseudostate->transitions.size());
+            }
             for(const auto& t : pseudostate->transitions)
             {
                 auto targets_ = determine_target_states(t->target());
@@ -213,7 +326,9 @@ std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::de
                 if (subscriber.is_subscribed()) {
                     subscriber.on_next(transition(t));
                 }
-                t->execute_action();
+                perform([this, t]() {
+                    execute(*t);
+                });
             }
             break;
         }
@@ -241,13 +356,17 @@ std::vector<std::shared_ptr<virtual_vertex_delegate>> state_machine_delegate::de
     return targets;
 }
 
-void state_machine_delegate::state_transition(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& target, const std::shared_ptr<transition_delegate::action>& action)
+void state_machine_delegate::state_transition(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& target, const std::shared_ptr<transition_delegate::action>& action, std::uint32_t transition)
 {
+    if (RX_FSM_PROBE_ENABLED(transition)) {
+        RX_FSM_PROBE(transition, trace_id, name.c_str(), transition, transitions_table[transition]->name.c_str(), current->state->id, target->id);
+    }
     // make transition
     // if transition is to a terminate pseudostate, preform action and terminate directly
     auto pseudostate = std::dynamic_pointer_cast<pseudostate_delegate>(target);
     if (pseudostate && pseudostate->type == pseudostate_kind::terminate) {
-        action->execute();
+        flush_recorded_actions();
+        execute(*action, transition);
         auto subscriber = subject.get_subscriber();
         if (subscriber.is_subscribed()) {
             subscriber.on_completed();
@@ -262,27 +381,21 @@ void state_machine_delegate::state_transition(const std::shared_ptr<current_stat
     std::shared_ptr<current_state> final_parent;
     bool all_regions_complete(true);
     if (final || (pseudostate && pseudostate->type == pseudostate_kind::join)) {
-        auto r = final ? target->owner<virtual_region_delegate>() : current->state->owner<virtual_region_delegate>();
+        auto r = final ? region_of(*target) : region_of(*current->state);
         auto current_region = r ? find_current_region(common, r) : std::shared_ptr<current_state>();
         if (current_region) {
-            current_region->status = final ? await_finalize : await_join;
+            set_region_status(current_region, final ? await_finalize : await_join);
             final_parent = current_region->parent.lock();
             if (final_parent) {
-                for(const auto& child : final_parent->children)
-                {
-                    auto status = child->status;
-                    if (status == active) {
-                        all_regions_complete = false;
-                        break;
-                    }
-                    if (final && status == await_join) {
-                        r->throw_exception<join_error>("cannot be finalized since another orthogonal region is awaiting join");
-                    }
-                    else if (!final && status == await_finalize) {
-                        r->throw_exception<join_error>("cannot be joined since another orthogonal region is already finalized");
-                    }
+                if (final && final_parent->regions[await_join] > 0) {
+                    r->throw_exception<join_error>("cannot be finalized since another orthogonal region is awaiting join");
+                }
+                else if (!final && final_parent->regions[await_finalize] > 0) {
+                    r->throw_exception<join_error>("cannot be joined since another orthogonal region is already finalized");
                 }
+                all_regions_complete = final_parent->regions[active] == 0;
             }
+            RX_FSM_TRACE(if (traced()) tracing->region_completed(trace_id, tracer::now(), target->id, all_regions_complete));
             if (!all_regions_complete) {
                 common = current_region;
             }
@@ -291,7 +404,9 @@ void state_machine_delegate::state_transition(const std::shared_ptr<current_stat
     // exit to common
     exit_states_recursively(common);
     // perform action
-    action->execute();
+    perform([this, action, transition]() {
+        execute(*action, transition);
+    });
     // no transition if not all regions is complete
     if (!all_regions_complete) {
         return;
@@ -314,9 +429,9 @@ void state_machine_delegate::state_transition(const std::shared_ptr<current_stat
     enter_states_recursively(common, target_states);
 }
 
-std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::find_current_state(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_vertex_delegate>& source_state) const
+std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::find_current_state(const std::shared_ptr<current_state>& current, const virtual_vertex_delegate* source_state) const
 {
-    if (current->state == source_state) {
+    if (current->state.get() == source_state) {
         return current;
     }
     for(const auto& child : current->children)
@@ -329,9 +444,9 @@ std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::f
     return std::shared_ptr<current_state>();
 }
 
-std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::find_current_region(const std::shared_ptr<current_state>& current, const std::shared_ptr<virtual_region_delegate>& source_region) const
+std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::find_current_region(const std::shared_ptr<current_state>& current, const virtual_region_delegate* source_region) const
 {
-    if (current->region.lock() == source_region) {
+    if (current->region == source_region) {
         return current;
     }
     for(const auto& child : current->children)
@@ -346,6 +461,9 @@ std::shared_ptr<state_machine_delegate::current_state> state_machine_delegate::f
 
 void state_machine_delegate::enter_state(const std::shared_ptr<current_state>& current)
 {
+    if (RX_FSM_PROBE_ENABLED(state_enter)) {
+        RX_FSM_PROBE(state_enter, trace_id, name.c_str(), current->state->id, current->state->name.c_str());
+    }
     auto s = std::dynamic_pointer_cast<state_delegate>(current->state);
     if (s) {
         if (s->type != state_delegate::simple) {
@@ -358,7 +476,7 @@ void state_machine_delegate::enter_state(const std::shared_ptr<current_state>& c
         }
     }
     std::weak_ptr<this_type> weak = shared_from_this();
-    auto& observable = state_observable[current->state];
+    auto& observable = frozen[current->state->id].transitions;
     auto on_next = [weak, current](const transition_delegate::transition_data& data) {
         auto self = weak.lock();
         if (!self) {
@@ -368,23 +486,30 @@ void state_machine_delegate::enter_state(const std::shared_ptr<current_state>& c
             auto s = std::dynamic_pointer_cast<state_delegate>(current->state);
             if (s) {
                 current->entered = true;
-                s->on_entry();
+                self->perform([self, s]() {
+                    self->enter_action(*s);
+                });
             }
         }
-        const auto& source = std::get<0>(data);
-        const auto& t = std::get<1>(data);
+        auto source = std::get<0>(data);
+        auto t = std::get<1>(data);
         const auto& action = std::get<2>(data);
-        const auto& target = t->target();
+        auto target = t->frozen_target;
         auto subscriber = self->subject.get_subscriber();
         if (subscriber.is_subscribed()) {
-            subscriber.on_next(transition(t));
+            // the public transition shares ownership of the delegate
+            subscriber.on_next(transition(t->shared_from_this()));
         }
         if (target) {
             auto s = self->find_current_state(current, source);
-            self->state_transition(s, target, action);
+            self->state_transition(s, self->handle_of(*target), action, t->id);
         } else {
-            action->execute();
+            auto transition = t->id;
+            self->perform([self, action, transition]() {
+                self->execute(*action, transition);
+            });
         }
+        RX_FSM_TRACE(self->trace_next_step());
     };
     auto subscr = subject.get_subscriber();
     auto on_error = [subscr](std::exception_ptr e) {
@@ -396,7 +521,9 @@ void state_machine_delegate::enter_state(const std::shared_ptr<current_state>& c
     observable.subscribe(current->state_lifetime, on_next, on_error);
     if (s && !current->entered) {
         current->entered = true;
-        s->on_entry();
+        perform([this, s]() {
+            enter_action(*s);
+        });
     }
 }
 
@@ -406,35 +533,35 @@ void state_machine_delegate::enter_states_recursively(const std::shared_ptr<curr
     auto parent = current->parent.lock();
     for(const auto& target : target_states)
     {
-        const auto& ancestors = state_ancestors[target];
-        state_ancestor_map::mapped_type::const_iterator it;
+        auto first = ancestors_begin(*target);
+        auto last = ancestors_end(*target);
+        ancestor_table::const_iterator it;
         if (parent) {
-            it = std::find(ancestors.begin(), ancestors.end(), parent->state);
-            if (it == ancestors.end()) {
+            it = std::find(first, last, parent->state);
+            if (it == last) {
                 throw_exception<internal_error>("illegal parent");
             }
             ++it;
         } else {
-            it = ancestors.begin();
+            it = first;
         }
         int level(0);
         auto cur = current;
         for(;;)
         {
-            const auto& s = it != ancestors.end() ? *it : target;
+            const auto& s = it != last ? *it : target;
             if (level > 0)
             {
                 auto it_ = std::find_if(cur->children.begin(), cur->children.end(), [&s](const std::shared_ptr<current_state>& c) {
                     return c->state == s;
                 });
                 if (it_ == cur->children.end()) {
-                    auto new_current = std::make_shared<current_state>();
+                    auto new_current = make_current_state();
                     new_current->status = active;
-                    new_current->region = s->owner<virtual_region_delegate>();
-                    new_current->parent = cur;
+                    new_current->region = region_of(*s);
                     new_current->state = s;
                     new_current->entered = false;
-                    cur->children.push_back(new_current);
+                    add_region(cur, new_current);
                     order.insert(std::make_pair(level, new_current));
                     cur = new_current;
                 } else {
@@ -450,38 +577,341 @@ void state_machine_delegate::enter_states_recursively(const std::shared_ptr<curr
                 cur->state = s;
                 order.insert(std::make_pair(level, cur));
             }
-            if (it == ancestors.end()) {
+            if (it == last) {
                 break;
             }
             ++level;
             ++it;
         }
     }
-    for(const auto& o : order)
+    for(auto it = order.begin(); it != order.end();)
     {
-        auto parent = o.second->parent.lock();
-        enter_state(o.second);
-        if (o.second->state_lifetime.is_subscribed()) {
-            o.second->lifetime.add(o.second->state_lifetime);
-            if (parent && parent->state) {
-                parent->state_lifetime.add(o.second->state_lifetime);
+        auto end = order.upper_bound(it->first);
+        if (!parallel_regions || recorded_actions || std::next(it) == end) {
+            for(; it != end; ++it)
+            {
+                if (!enter_and_adopt(it->second)) {
+                    return;
+                }
+            }
+            continue;
+        }
+        // states on the same level are in different orthogonal regions, the user actions of each region are
+        // recorded while entering it and replayed concurrently afterwards
+        std::vector<std::vector<std::function<void()>>> recorded(std::distance(it, end));
+        bool exited(false);
+        std::size_t i(0);
+        for(; it != end; ++it, ++i)
+        {
+            recording_scope scope(this, &recorded[i]);
+            bool entered = enter_and_adopt(it->second);
+            if (!entered) {
+                exited = true;
+                break;
+            }
+        }
+        if (exited) {
+            // the step left the regions, replay in the order they were recorded
+            for(const auto& actions : recorded)
+            {
+                for(const auto& a : actions)
+                {
+                    a();
+                }
+            }
+            return;
+        }
+        std::vector<std::function<void()>> regions;
+        for(auto& actions : recorded)
+        {
+            if (!actions.empty()) {
+                auto shared = std::make_shared<std::vector<std::function<void()>>>(std::move(actions));
+                regions.push_back([shared]() {
+                    for(const auto& a : *shared)
+                    {
+                        a();
+                    }
+                });
             }
-        } else {
-            break;
         }
+        run_parallel(regions);
+    }
+}
+
+bool state_machine_delegate::enter_and_adopt(const std::shared_ptr<current_state>& current)
+{
+    auto parent = current->parent.lock();
+    enter_state(current);
+    if (!current->state_lifetime.is_subscribed()) {
+        return false;
     }
+    current->lifetime.add(current->state_lifetime);
+    if (parent && parent->state) {
+        parent->state_lifetime.add(current->state_lifetime);
+    }
+    return true;
+}
+
+namespace {
+
+// the state machine recording actions on the calling thread, if any
+thread_local const state_machine_delegate* recording_machine = nullptr;
+
 }
 
-void state_machine_delegate::guard_executed(const std::shared_ptr<virtual_vertex_delegate>& state) const
+state_machine_delegate::recording_scope::recording_scope(state_machine_delegate* sm, std::vector<std::function<void()>>* actions)
+    : machine(sm)
+    , outer(recording_machine)
 {
+    machine->recorded_actions = actions;
+    recording_machine = machine;
+}
+
+state_machine_delegate::recording_scope::~recording_scope()
+{
+    machine->recorded_actions = nullptr;
+    recording_machine = outer;
+}
+
+namespace {
+
+struct parallel_batch
+{
+    std::vector<std::function<void()>> actions;
+    std::unique_ptr<std::atomic<bool>[]> claimed;
+    std::mutex lock;
+    std::condition_variable done;
+    std::size_t remaining;
+    std::exception_ptr error;
+
+    explicit parallel_batch(const std::vector<std::function<void()>>& a)
+        : actions(a)
+        , claimed(new std::atomic<bool>[a.size()])
+        , remaining(a.size())
+    {
+        for(std::size_t i = 0; i < actions.size(); ++i)
+        {
+            claimed[i].store(false);
+        }
+    }
+
+    void run(std::size_t i)
+    {
+        bool expected(false);
+        if (!claimed[i].compare_exchange_strong(expected, true)) {
+            return;
+        }
+        std::exception_ptr e;
+        try {
+            actions[i]();
+        } catch (...) {
+            e = std::current_exception();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (e && !error) {
+            error = e;
+        }
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+    }
+};
+
+}
+
+void state_machine_delegate::flush_recorded_actions() const
+{
+    if (recording_machine == this && recorded_actions) {
+        std::vector<std::function<void()>> actions;
+        actions.swap(*recorded_actions);
+        for(const auto& a : actions)
+        {
+            a();
+        }
+    }
+}
+
+void state_machine_delegate::run_parallel(const std::vector<std::function<void()>>& actions)
+{
+    if (actions.size() < 2) {
+        for(const auto& a : actions)
+        {
+            a();
+        }
+        return;
+    }
+    if (!region_workers.empty() && !region_workers.front().is_subscribed()) {
+        // terminated and started again
+        region_workers.clear();
+    }
+    while (region_workers.size() < actions.size() - 1)
+    {
+        composite_subscription cs;
+        current->lifetime.add(cs);
+        region_workers.push_back(region_scheduler.create_worker(cs));
+    }
+    auto batch = std::make_shared<parallel_batch>(actions);
+    for(std::size_t i = 1; i < actions.size(); ++i)
+    {
+        const auto& worker = region_workers[i - 1];
+        worker.schedule(rxsc::make_schedulable(worker, [batch, i](const rxsc::schedulable&) {
+            batch->run(i);
+        }));
+    }
+    // execute the actions not yet picked up by a worker here, so that the step never waits for a busy worker
+    for(std::size_t i = 0; i < actions.size(); ++i)
+    {
+        batch->run(i);
+    }
+    std::unique_lock<std::mutex> guard(batch->lock);
+    batch->done.wait(guard, [&batch]() {
+        return batch->remaining == 0;
+    });
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+void state_machine_delegate::add_tracer(std::shared_ptr<tracer> t)
+{
+    tracers.push_back(std::move(t));
+    if (tracers.size() == 1) {
+        tracing = tracers.front();
+    } else {
+        tracing = std::make_shared<tracer_list>(tracers);
+    }
+}
+
+void state_machine_delegate::trace_assembled()
+{
+    if (!tracing) {
+        return;
+    }
+    auto path_of = [this](const element_delegate& e) {
+        std::string path(e.name);
+        for(auto o = e.owner_.lock(); o && o.get() != this; o = o->owner_.lock())
+        {
+            if (!o->name.empty()) {
+                path = o->name + "/" + path;
+            }
+        }
+        return path;
+    };
+    std::vector<std::string> vertex_names, transition_names;
+    vertex_names.reserve(vertices.size());
+    for(const auto& v : vertices)
+    {
+        vertex_names.push_back(path_of(*v));
+    }
+    transition_names.reserve(transitions_table.size());
+    for(const auto& t : transitions_table)
+    {
+        transition_names.push_back(path_of(*t));
+    }
+    if (metering) {
+        metering->transition_sources.reserve(transitions_table.size());
+        metering->triggers.reserve(transitions_table.size());
+        metering->timeouts.reserve(transitions_table.size());
+        for(const auto& t : transitions_table)
+        {
+            metering->transition_sources.push_back(t->frozen_source->id);
+            metering->triggers.push_back(t->type != transition_delegate::completion);
+            metering->timeouts.push_back(t->type == transition_delegate::timeout);
+        }
+    }
+    tracing->assembled(trace_id, name, vertex_names, transition_names);
+    trace_entered.assign(vertices.size(), 0);
+    trace_steps = 0;
+    trace_step.store(tracing->sample(trace_id, trace_steps++), std::memory_order_relaxed);
+}
+
+void state_machine_delegate::trace_next_step()
+{
+    if (tracing) {
+        trace_step.store(tracing->sample(trace_id, trace_steps++), std::memory_order_relaxed);
+    }
+}
+
+void state_machine_delegate::trace_ignored(const event_id& id) const
+{
+    if (traced()) {
+        tracing->event_ignored(trace_id, tracer::now(), id.value());
+    }
+}
+
+void state_machine_delegate::enter_action(state_delegate& s) const
+{
+#if defined(RXCPP_FSM_TRACING)
+    if (tracing) {
+        if (!trace_step.load(std::memory_order_relaxed)) {
+            // an exit traced later must not refer to an earlier entry
+            trace_entered[s.id] = 0;
+            s.on_entry();
+            return;
+        }
+        auto start = tracer::now();
+        s.on_entry();
+        trace_entered[s.id] = start;
+        tracing->state_entered(trace_id, start, tracer::now(), s.id);
+        return;
+    }
+#endif
+    s.on_entry();
+}
+
+void state_machine_delegate::exit_action(state_delegate& s) const
+{
+#if defined(RXCPP_FSM_TRACING)
+    if (traced()) {
+        auto start = tracer::now();
+        s.on_exit();
+        tracing->state_exited(trace_id, start, tracer::now(), s.id, trace_entered[s.id]);
+        return;
+    }
+#endif
+    s.on_exit();
+}
+
+void state_machine_delegate::execute(transition_delegate::action& a, std::uint32_t transition) const
+{
+#if defined(RXCPP_FSM_TRACING)
+    if (traced()) {
+        auto start = tracer::now();
+        a.execute();
+        tracing->action_executed(trace_id, start, tracer::now(), transition);
+        return;
+    }
+#else
+    (void)transition;
+#endif
+    a.execute();
+}
+
+void state_machine_delegate::execute(transition_delegate& t) const
+{
+#if defined(RXCPP_FSM_TRACING)
+    if (traced()) {
+        auto start = tracer::now();
+        t.execute_action();
+        tracing->action_executed(trace_id, start, tracer::now(), t.id);
+        return;
+    }
+#endif
+    t.execute_action();
+}
+
+void state_machine_delegate::guard_executed(virtual_vertex_delegate* state) const
+{
+    // a guard observes everything performed before it
+    flush_recorded_actions();
     if (state) {
         auto current = find_current_state(this->current, state);
         if (current && !current->entered)
         {
-            auto s = std::dynamic_pointer_cast<state_delegate>(state);
+            auto s = dynamic_cast<state_delegate*>(state);
             if (s) {
                 current->entered = true;
-                s->on_entry();
+                enter_action(*s);
             }
         }
     }
@@ -549,10 +979,10 @@ void state_machine_delegate::find_reachable_states_recursively(std::unordered_ma
                     }
                 }
                 find_reachable_states_recursively(states_reached, tgt);
-                for(const auto& ancestor : state_ancestors.at(tgt))
+                for(auto ancestor = ancestors_begin(*tgt); ancestor != ancestors_end(*tgt); ++ancestor)
                 {
-                    states_reached[ancestor] = false;
-                    find_reachable_states_recursively(states_reached, ancestor);
+                    states_reached[*ancestor] = false;
+                    find_reachable_states_recursively(states_reached, *ancestor);
                 }
             }
         }
@@ -566,9 +996,8 @@ std::vector<std::string> state_machine_delegate::find_unreachable_states() const
     states_reached[initial] = false;
     find_reachable_states_recursively(states_reached, initial);
     std::vector<std::string> state_names;
-    for(const auto& pair : state_ancestors)
+    for(const auto& state : vertices)
     {
-        const auto& state = pair.first;
         auto it = states_reached.find(state);
         if (it == states_reached.end()) {
             state_names.push_back(state->name);
@@ -577,6 +1006,18 @@ std::vector<std::string> state_machine_delegate::find_unreachable_states() const
     return state_names;
 }
 
+void state_machine_delegate::build_event_table()
+{
+    std::vector<std::shared_ptr<event_slot_base>> slots;
+    for(const auto& pair : event_slots)
+    {
+        pair.second->dispatcher = broadcast;
+        slots.push_back(pair.second);
+    }
+    events.build(std::move(slots));
+    events_ready.store(true, std::memory_order_release);
+}
+
 std::string state_machine_delegate::type_name() const
 {
     return "state machine";
@@ -585,14 +1026,28 @@ std::string state_machine_delegate::type_name() const
 state_machine_delegate::state_machine_delegate(std::string n, const std::shared_ptr<element_delegate>& o)
     : virtual_region_delegate(std::move(n), o)
     , assembled(false)
+    , pool(std::make_shared<node_pool>())
     , subject(subject_lifetime)
+    , events_ready(false)
+    , trace_id(next_trace_id())
+    , trace_step(false)
+    , trace_steps(0)
+    , parallel_regions(false)
+    , recorded_actions(nullptr)
 {
 }
 
 state_machine_delegate::state_machine_delegate(std::string n)
     : virtual_region_delegate(std::move(n))
     , assembled(false)
+    , pool(std::make_shared<node_pool>())
     , subject(subject_lifetime)
+    , events_ready(false)
+    , trace_id(next_trace_id())
+    , trace_step(false)
+    , trace_steps(0)
+    , parallel_regions(false)
+    , recorded_actions(nullptr)
 {
 }
 
@@ -649,6 +1104,86 @@ std::vector<std::string> state_machine::find_unreachable_states() const
     return delegate->find_unreachable_states();
 }
 
+state_machine& state_machine::with_broadcast_dispatcher(const broadcast_dispatcher& dispatcher)
+{
+    if (delegate->is_assembled()) {
+        delegate->throw_exception<not_allowed>("state machine already assembled");
+    }
+    delegate->broadcast = dispatcher();
+    return *this;
+}
+
+state_machine& state_machine::with_parallel_regions(rxsc::scheduler sc)
+{
+    if (delegate->is_assembled()) {
+        delegate->throw_exception<not_allowed>("state machine already assembled");
+    }
+    delegate->parallel_regions = true;
+    delegate->region_scheduler = std::move(sc);
+    return *this;
+}
+
+state_machine& state_machine::with_virtual_time(const virtual_time& vt)
+{
+    if (delegate->is_assembled()) {
+        delegate->throw_exception<not_allowed>("state machine already assembled");
+    }
+    delegate->clock = vt();
+    return *this;
+}
+
+state_machine& state_machine::with_tracer(std::shared_ptr<tracer> t)
+{
+    if (delegate->is_assembled()) {
+        delegate->throw_exception<not_allowed>("state machine already assembled");
+    }
+    delegate->add_tracer(std::move(t));
+    return *this;
+}
+
+state_machine& state_machine::with_metrics()
+{
+    if (delegate->is_assembled()) {
+        delegate->throw_exception<not_allowed>("state machine already assembled");
+    }
+#if !defined(RXCPP_FSM_TRACING)
+    delegate->throw_exception<not_allowed>("cannot collect metrics since the library is built without RXCPP_FSM_TRACING");
+#endif
+    if (!delegate->metering) {
+        delegate->metering = std::make_shared<detail::metrics_delegate>();
+        delegate->add_tracer(delegate->metering);
+    }
+    return *this;
+}
+
+fsm::metrics state_machine::metrics() const
+{
+    if (!delegate->metering) {
+        delegate->throw_exception<not_allowed>("collects no metrics");
+    }
+    auto m = delegate->metering->snapshot();
+    m.name = delegate->name;
+    return m;
+}
+
+bool state_machine::fire(const event_id& id)
+{
+    return fire(id, id);
+}
+
+event_table_stats state_machine::event_stats() const
+{
+    if (!delegate->events_ready.load(std::memory_order_acquire)) {
+        delegate->throw_exception<not_allowed>("must be assembled");
+    }
+    return delegate->events.stats();
+}
+
+node_pool_stats state_machine::pool_stats() const
+{
+    return delegate->pool->stats();
+}
+
 state_machine make_state_machine(std::string name)
 {
     return state_machine(std::move(name));
@@ -0,0 +1,173 @@
+/*! \file  rx-fsm-tracer.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include <atomic>
+#include <chrono>
+
+#include "rxcpp/fsm/rx-fsm-tracer.hpp"
+
+#if defined(RXCPP_FSM_USDT)
+// the semaphores counting the attached consumers of every probe, set by the tracing tools
+#define RX_FSM_SEMAPHORE(name) volatile unsigned short rxcpp_fsm_##name##_semaphore __attribute__((section(".probes"))) = 0
+extern "C" {
+RX_FSM_SEMAPHORE(state_enter);
+RX_FSM_SEMAPHORE(state_exit);
+RX_FSM_SEMAPHORE(transition);
+RX_FSM_SEMAPHORE(guard);
+RX_FSM_SEMAPHORE(history);
+RX_FSM_SEMAPHORE(fork);
+}
+#undef RX_FSM_SEMAPHORE
+#endif
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+std::uint32_t next_trace_id()
+{
+    static std::atomic<std::uint32_t> id(0);
+    return id.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+std::uint64_t tracer::now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void tracer::assembled(std::uint32_t, const std::string&, const std::vector<std::string>&, const std::vector<std::string>&)
+{
+}
+
+bool tracer::sample(std::uint32_t, std::uint64_t)
+{
+    return true;
+}
+
+void tracer::guard_evaluated(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t, bool)
+{
+}
+
+void tracer::action_executed(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t)
+{
+}
+
+void tracer::state_entered(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t)
+{
+}
+
+void tracer::state_exited(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t, std::uint64_t)
+{
+}
+
+void tracer::history_restored(std::uint32_t, std::uint64_t, std::uint32_t, std::size_t)
+{
+}
+
+void tracer::region_completed(std::uint32_t, std::uint64_t, std::uint32_t, bool)
+{
+}
+
+void tracer::event_ignored(std::uint32_t, std::uint64_t, std::uint64_t)
+{
+}
+
+void tracer::event_unhandled(std::uint32_t, std::uint64_t, std::uint32_t)
+{
+}
+
+namespace detail {
+
+tracer_list::tracer_list(std::vector<std::shared_ptr<tracer>> t)
+    : tracers(std::move(t))
+    , sampled(new std::atomic<bool>[tracers.size()])
+{
+    for(std::size_t i = 0; i < tracers.size(); ++i)
+    {
+        sampled[i].store(false);
+    }
+}
+
+void tracer_list::assembled(std::uint32_t machine, const std::string& name, const std::vector<std::string>& vertices, const std::vector<std::string>& transitions)
+{
+    for(const auto& t : tracers)
+    {
+        t->assembled(machine, name, vertices, transitions);
+    }
+}
+
+bool tracer_list::sample(std::uint32_t machine, std::uint64_t step)
+{
+    bool any(false);
+    for(std::size_t i = 0; i < tracers.size(); ++i)
+    {
+        auto s = tracers[i]->sample(machine, step);
+        sampled[i].store(s, std::memory_order_relaxed);
+        any = any || s;
+    }
+    return any;
+}
+
+// forwards a trace point to the tracers sampling the current step
+#define RX_FSM_FORWARD(call) \
+    for(std::size_t i = 0; i < tracers.size(); ++i) \
+    { \
+        if (sampled[i].load(std::memory_order_relaxed)) { \
+            tracers[i]->call; \
+        } \
+    }
+
+void tracer_list::guard_evaluated(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition, bool passed)
+{
+    RX_FSM_FORWARD(guard_evaluated(machine, start, end, transition, passed))
+}
+
+void tracer_list::action_executed(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t transition)
+{
+    RX_FSM_FORWARD(action_executed(machine, start, end, transition))
+}
+
+void tracer_list::state_entered(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state)
+{
+    RX_FSM_FORWARD(state_entered(machine, start, end, state))
+}
+
+void tracer_list::state_exited(std::uint32_t machine, std::uint64_t start, std::uint64_t end, std::uint32_t state, std::uint64_t entered)
+{
+    RX_FSM_FORWARD(state_exited(machine, start, end, state, entered))
+}
+
+void tracer_list::history_restored(std::uint32_t machine, std::uint64_t time, std::uint32_t history, std::size_t states)
+{
+    RX_FSM_FORWARD(history_restored(machine, time, history, states))
+}
+
+void tracer_list::region_completed(std::uint32_t machine, std::uint64_t time, std::uint32_t vertex, bool completed)
+{
+    RX_FSM_FORWARD(region_completed(machine, time, vertex, completed))
+}
+
+void tracer_list::event_ignored(std::uint32_t machine, std::uint64_t time, std::uint64_t event)
+{
+    RX_FSM_FORWARD(event_ignored(machine, time, event))
+}
+
+void tracer_list::event_unhandled(std::uint32_t machine, std::uint64_t time, std::uint32_t state)
+{
+    RX_FSM_FORWARD(event_unhandled(machine, time, state))
+}
+
+#undef RX_FSM_FORWARD
+
+}
+
+}
+}
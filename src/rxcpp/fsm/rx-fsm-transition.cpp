@@ -9,6 +9,7 @@
 #include "rxcpp/fsm/rx-fsm-pseudostate.hpp"
 #include "rxcpp/fsm/rx-fsm-state.hpp"
 #include "rxcpp/fsm/rx-fsm-state_machine.hpp"
+#include "rx-fsm-probes.hpp"
 
 namespace rxcpp {
 
@@ -26,9 +27,57 @@ std::string transition_delegate::type_name() const
     return "transition";
 }
 
+void transition_delegate::freeze()
+{
+    frozen_source = owner<virtual_vertex_delegate>().get();
+    frozen_target = target().get();
+}
+
+// the guards may still be evaluated on a trigger thread while the state machine is destroyed, i.e. they lock the root
+
 void transition_delegate::guard_executed() const
 {
-    state_machine()->guard_executed(owner<virtual_vertex_delegate>());
+    auto sm = root();
+    if (sm) {
+        sm->guard_executed(frozen_source);
+    }
+}
+
+std::uint64_t transition_delegate::trace_start() const
+{
+    auto sm = root();
+    return sm && sm->traced() ? tracer::now() : 0;
+}
+
+void transition_delegate::trace_guard(std::uint64_t start, bool passed) const
+{
+    if (start) {
+        auto sm = root();
+        if (sm) {
+            sm->tracing->guard_evaluated(sm->trace_id, start, tracer::now(), id, passed);
+        }
+    }
+}
+
+void transition_delegate::trace_unhandled() const
+{
+    auto sm = root();
+    if (sm && sm->traced()) {
+        sm->tracing->event_unhandled(sm->trace_id, tracer::now(), frozen_source->id);
+    }
+}
+
+void transition_delegate::probe_guard(bool passed) const
+{
+#if defined(RXCPP_FSM_USDT)
+    auto sm = root();
+    if (!sm) {
+        return;
+    }
+    RX_FSM_PROBE(guard, sm->trace_id, sm->name.c_str(), id, name.c_str(), passed ? 1 : 0);
+#else
+    (void)passed;
+#endif
 }
 
 transition_delegate::transition_delegate(bool g, const std::shared_ptr<virtual_vertex_delegate>& tgt, std::string n, const std::shared_ptr<virtual_vertex_delegate>& o, transition_t t)
@@ -37,6 +86,9 @@ transition_delegate::transition_delegate(bool g, const std::shared_ptr<virtual_v
     , target_(tgt)
     , type(t)
     , blocked(false)
+    , frozen_source(nullptr)
+    , frozen_target(nullptr)
+    , id(0)
 {
 }
 
@@ -45,6 +97,9 @@ transition_delegate::transition_delegate(bool g, std::string n, const std::share
     , guarded(g)
     , type(t)
     , blocked(false)
+    , frozen_source(nullptr)
+    , frozen_target(nullptr)
+    , id(0)
 {
 }
 
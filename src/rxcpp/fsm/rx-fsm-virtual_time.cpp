@@ -0,0 +1,75 @@
+/*! \file  rx-fsm-virtual_time.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-virtual_time.hpp"
+#include "rxcpp/fsm/rx-fsm-state_machine.hpp"
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+long to_ticks(rxsc::scheduler::clock_type::duration duration)
+{
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+}
+
+}
+
+virtual_time_delegate::virtual_time_delegate()
+    : scheduler(rxsc::make_test())
+    , worker(scheduler.create_worker())
+{
+}
+
+bool create_virtual_timer(const std::shared_ptr<virtual_vertex_delegate>& owner, rxsc::scheduler::clock_type::duration dur, observable<long>& timer)
+{
+    auto root = owner->root();
+    if (!root || !root->clock) {
+        return false;
+    }
+    timer = observable<>::timer(dur, identity_one_worker(root->clock->scheduler)).as_dynamic();
+    return true;
+}
+
+}
+
+virtual_time::virtual_time(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+identity_one_worker virtual_time::coordination() const
+{
+    return identity_one_worker(delegate->scheduler);
+}
+
+rxsc::scheduler::clock_type::time_point virtual_time::now() const
+{
+    return delegate->scheduler.now();
+}
+
+void virtual_time::advance_by(rxsc::scheduler::clock_type::duration duration) const
+{
+    delegate->worker.advance_by(detail::to_ticks(duration));
+}
+
+void virtual_time::advance_to(rxsc::scheduler::clock_type::time_point time) const
+{
+    delegate->worker.advance_to(detail::to_ticks(time.time_since_epoch()));
+}
+
+virtual_time make_virtual_time()
+{
+    return virtual_time(std::make_shared<detail::virtual_time_delegate>());
+}
+
+}
+}
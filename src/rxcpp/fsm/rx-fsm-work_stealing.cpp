@@ -0,0 +1,406 @@
+/*! \file  rx-fsm-work_stealing.cpp
+
+    \copyright  Copyright (c) 2019, emJay Software Consulting AB. All rights reserved. Use of this source code is governed by the Apache-2.0 license, that can be found in the LICENSE.md file.
+    \author     Mattias Johansson
+*/
+
+
+#include "rxcpp/fsm/rx-fsm-work_stealing.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <thread>
+
+namespace rxcpp {
+
+namespace fsm {
+
+namespace detail {
+
+namespace {
+
+typedef rxsc::scheduler_base::clock_type clock_type;
+
+struct work_stealing_pool;
+
+struct strand : public rxsc::worker_interface
+{
+    std::shared_ptr<work_stealing_pool> pool;
+    mutable std::mutex lock;
+    mutable std::deque<rxsc::schedulable> queue;
+    // true while queued on, or running on, a worker thread
+    mutable bool scheduled;
+    // the worker thread the strand last ran on
+    mutable std::atomic<std::size_t> home;
+
+    strand(std::shared_ptr<work_stealing_pool> p, std::size_t h)
+        : pool(std::move(p))
+        , scheduled(false)
+        , home(h)
+    {
+    }
+
+    virtual clock_type::time_point now() const override
+    {
+        return clock_type::now();
+    }
+
+    virtual void schedule(const rxsc::schedulable& scbl) const override;
+
+    virtual void schedule(clock_type::time_point when, const rxsc::schedulable& scbl) const override;
+};
+
+struct work_stealing_pool
+{
+    typedef std::shared_ptr<const strand> strand_ptr;
+
+    struct thread_queue
+    {
+        std::mutex lock;
+        std::deque<strand_ptr> strands;
+    };
+
+    struct timed_item
+    {
+        clock_type::time_point when;
+        std::uint64_t order;
+        strand_ptr target;
+        rxsc::schedulable what;
+    };
+
+    struct later
+    {
+        bool operator()(const timed_item& lhs, const timed_item& rhs) const
+        {
+            return lhs.when > rhs.when || (lhs.when == rhs.when && lhs.order > rhs.order);
+        }
+    };
+
+    // number of actions a strand executes each time it runs
+    static const std::size_t batch = 64;
+
+    std::vector<std::unique_ptr<thread_queue>> queues;
+    std::atomic<std::size_t> pending, sleeping, next_home, strands;
+    std::atomic<std::uint64_t> runs, steals;
+    std::atomic<bool> stop;
+
+    std::mutex idle_lock;
+    std::condition_variable idle;
+
+    std::mutex timer_lock;
+    std::condition_variable timer_wake;
+    std::priority_queue<timed_item, std::vector<timed_item>, later> timers;
+    std::uint64_t timer_order;
+
+    explicit work_stealing_pool(std::size_t threads)
+        : pending(0)
+        , sleeping(0)
+        , next_home(0)
+        , strands(0)
+        , runs(0)
+        , steals(0)
+        , stop(false)
+        , timer_order(0)
+    {
+        for(std::size_t i = 0; i < threads; ++i)
+        {
+            queues.emplace_back(new thread_queue());
+        }
+    }
+
+    void push(std::size_t i, strand_ptr s)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queues[i]->lock);
+            queues[i]->strands.push_back(std::move(s));
+        }
+        pending.fetch_add(1);
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> guard(idle_lock);
+            idle.notify_all();
+        }
+    }
+
+    strand_ptr pop(std::size_t i)
+    {
+        std::lock_guard<std::mutex> guard(queues[i]->lock);
+        auto& strands = queues[i]->strands;
+        if (strands.empty()) {
+            return strand_ptr();
+        }
+        auto s = std::move(strands.front());
+        strands.pop_front();
+        pending.fetch_sub(1);
+        return s;
+    }
+
+    strand_ptr steal(std::size_t i)
+    {
+        for(std::size_t n = 1; n < queues.size(); ++n)
+        {
+            auto victim = (i + n) % queues.size();
+            std::lock_guard<std::mutex> guard(queues[victim]->lock);
+            auto& strands = queues[victim]->strands;
+            if (strands.empty()) {
+                continue;
+            }
+            // take the strand most recently queued by the victim, i.e. the one it would run last, the victim runs
+            // its strands in FIFO order so a strand requeued after exhausting its batch does not starve the others
+            auto s = std::move(strands.back());
+            strands.pop_back();
+            pending.fetch_sub(1);
+            steals.fetch_add(1, std::memory_order_relaxed);
+            s->home.store(i);
+            return s;
+        }
+        return strand_ptr();
+    }
+
+    void run(std::size_t i, const strand_ptr& s)
+    {
+        runs.fetch_add(1, std::memory_order_relaxed);
+        rxsc::recursion r;
+        r.reset(false);
+        for(std::size_t n = 0; n < batch; ++n)
+        {
+            std::unique_lock<std::mutex> guard(s->lock);
+            if (s->queue.empty()) {
+                s->scheduled = false;
+                return;
+            }
+            auto what = std::move(s->queue.front());
+            s->queue.pop_front();
+            guard.unlock();
+            if (what.is_subscribed()) {
+                what(r.get_recurse());
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(s->lock);
+            if (s->queue.empty()) {
+                s->scheduled = false;
+                return;
+            }
+        }
+        // batch exhausted, give the other strands of this worker thread a chance
+        push(i, s);
+    }
+
+    void work(std::size_t i)
+    {
+        while (!stop.load())
+        {
+            auto s = pop(i);
+            if (!s) {
+                s = steal(i);
+            }
+            if (s) {
+                run(i, s);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_lock);
+            sleeping.fetch_add(1);
+            while (!stop.load() && pending.load() == 0)
+            {
+                idle.wait(guard);
+            }
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    void schedule_at(clock_type::time_point when, strand_ptr target, const rxsc::schedulable& what)
+    {
+        std::lock_guard<std::mutex> guard(timer_lock);
+        timed_item item = {when, timer_order++, std::move(target), what};
+        timers.push(std::move(item));
+        timer_wake.notify_one();
+    }
+
+    void timer()
+    {
+        std::unique_lock<std::mutex> guard(timer_lock);
+        while (!stop.load())
+        {
+            if (timers.empty()) {
+                timer_wake.wait(guard);
+                continue;
+            }
+            if (clock_type::now() < timers.top().when) {
+                timer_wake.wait_until(guard, timers.top().when);
+                continue;
+            }
+            auto item = timers.top();
+            timers.pop();
+            guard.unlock();
+            item.target->schedule(item.what);
+            guard.lock();
+        }
+    }
+
+    void shutdown()
+    {
+        stop.store(true);
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+            idle.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> guard(timer_lock);
+            timer_wake.notify_all();
+        }
+    }
+
+    void clear()
+    {
+        // break the cycles between the pool and the queued strands
+        for(auto& q : queues)
+        {
+            std::lock_guard<std::mutex> guard(q->lock);
+            q->strands.clear();
+        }
+        std::lock_guard<std::mutex> guard(timer_lock);
+        while (!timers.empty())
+        {
+            timers.pop();
+        }
+    }
+};
+
+void strand::schedule(const rxsc::schedulable& scbl) const
+{
+    if (!scbl.is_subscribed() || pool->stop.load()) {
+        return;
+    }
+    bool ready(false);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(scbl);
+        if (!scheduled) {
+            scheduled = true;
+            ready = true;
+        }
+    }
+    if (ready) {
+        pool->push(home.load(), std::static_pointer_cast<const strand>(shared_from_this()));
+    }
+}
+
+void strand::schedule(clock_type::time_point when, const rxsc::schedulable& scbl) const
+{
+    if (when <= clock_type::now()) {
+        schedule(scbl);
+        return;
+    }
+    if (!scbl.is_subscribed() || pool->stop.load()) {
+        return;
+    }
+    pool->schedule_at(when, std::static_pointer_cast<const strand>(shared_from_this()), scbl);
+}
+
+struct work_stealing_scheduler : public rxsc::scheduler_interface
+{
+    std::shared_ptr<work_stealing_pool> pool;
+
+    explicit work_stealing_scheduler(std::shared_ptr<work_stealing_pool> p)
+        : pool(std::move(p))
+    {
+    }
+
+    virtual clock_type::time_point now() const override
+    {
+        return clock_type::now();
+    }
+
+    virtual rxsc::worker create_worker(composite_subscription cs) const override
+    {
+        auto s = std::make_shared<strand>(pool, pool->next_home.fetch_add(1) % pool->queues.size());
+        pool->strands.fetch_add(1, std::memory_order_relaxed);
+        std::weak_ptr<strand> weak = s;
+        cs.add([weak]() {
+            auto s = weak.lock();
+            if (s) {
+                std::lock_guard<std::mutex> guard(s->lock);
+                s->queue.clear();
+            }
+        });
+        return rxsc::worker(cs, s);
+    }
+};
+
+}
+
+struct work_stealing_delegate
+{
+    std::shared_ptr<work_stealing_pool> pool;
+    rxsc::scheduler scheduler;
+    std::vector<std::thread> threads;
+
+    explicit work_stealing_delegate(std::size_t n)
+        : pool(std::make_shared<work_stealing_pool>(n))
+        , scheduler(rxsc::make_scheduler<work_stealing_scheduler>(pool))
+    {
+        auto p = pool;
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            threads.emplace_back([p, i]() {
+                p->work(i);
+            });
+        }
+        threads.emplace_back([p]() {
+            p->timer();
+        });
+    }
+
+    ~work_stealing_delegate()
+    {
+        pool->shutdown();
+        for(auto& t : threads)
+        {
+            if (t.get_id() == std::this_thread::get_id()) {
+                t.detach();
+            } else {
+                t.join();
+            }
+        }
+        pool->clear();
+    }
+};
+
+}
+
+work_stealing::work_stealing(std::shared_ptr<delegate_type> d)
+    : delegate(std::move(d))
+{
+}
+
+rxsc::scheduler work_stealing::get_scheduler() const
+{
+    return delegate->scheduler;
+}
+
+identity_same_worker work_stealing::create_coordination() const
+{
+    return identity_same_worker(delegate->scheduler.create_worker());
+}
+
+work_stealing_stats work_stealing::stats() const
+{
+    work_stealing_stats s;
+    s.threads = delegate->pool->queues.size();
+    s.strands = delegate->pool->strands.load();
+    s.runs = delegate->pool->runs.load();
+    s.steals = delegate->pool->steals.load();
+    return s;
+}
+
+work_stealing make_work_stealing(std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    return work_stealing(std::make_shared<detail::work_stealing_delegate>(threads));
+}
+
+}
+}
@@ -0,0 +1,65 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "buffer", "[fsm][event][buffer]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("a buffer pool"){
+        auto pool = fsm::make_buffer_pool(1);
+        WHEN("buffers are released"){
+            const char text[] = "message";
+            auto b1 = pool.copy(text, sizeof(text));
+            CHECK(b1.size() == sizeof(text));
+            CHECK(std::string(reinterpret_cast<const char*>(b1.data())) == "message");
+            auto b2 = b1;
+            CHECK(b2.data() == b1.data());
+            auto b3 = pool.fill(4096, [](std::uint8_t* p) { std::fill(p, p + 4096, std::uint8_t(7)); });
+            CHECK(b3.size() == 4096);
+            CHECK(b3.data()[4095] == 7);
+            auto stats = pool.stats();
+            CHECK(stats.allocated == 2);
+            CHECK(stats.cached == 0);
+            b1 = fsm::buffer();
+            CHECK(pool.stats().cached == 0);
+            b2 = fsm::buffer();
+            b3 = fsm::buffer();
+            stats = pool.stats();
+            CHECK(stats.cached == 1);
+            auto b4 = pool.copy(text, sizeof(text));
+            stats = pool.stats();
+            CHECK(stats.allocated == 2);
+            CHECK(stats.recycled == 1);
+            CHECK(stats.cached == 0);
+            CHECK(fsm::buffer().empty());
+        }
+    }
+    GIVEN("buffers fired as events"){
+        auto pool = fsm::make_buffer_pool();
+        std::vector<const std::uint8_t*> guarded, received;
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_internal", sm.on_event<fsm::buffer>("DATA"), [&received](const fsm::buffer& b) {
+            received.push_back(b.data());
+        }, [&guarded](const fsm::buffer& b) {
+            guarded.push_back(b.data());
+            return !b.empty();
+        });
+        sm.with_state(initial, s1);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            auto b = pool.fill(65536, [](std::uint8_t* p) { p[0] = 1; });
+            CHECK(sm.fire("DATA", b));
+            CHECK(sm.fire("DATA", fsm::buffer()));
+            REQUIRE(guarded.size() == 2);
+            REQUIRE(received.size() == 1);
+            CHECK(guarded[0] == b.data());
+            CHECK(received[0] == b.data());
+            auto data = b.data();
+            b = fsm::buffer();
+            CHECK(pool.stats().cached == 1);
+            CHECK(sm.fire("DATA", pool.fill(65536, [](std::uint8_t* p) { p[0] = 2; })));
+            REQUIRE(received.size() == 2);
+            CHECK(received[1] == data);
+            CHECK(pool.stats().allocated == 1);
+        }
+    }
+}
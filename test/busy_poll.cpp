@@ -0,0 +1,58 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "busy poll", "[fsm][busy_poll]"){
+    auto cn = fsm::make_busy_poll(std::chrono::microseconds(20));
+    FSM_SUBJECT(1);
+    GIVEN("a state machine with a timeout transition"){
+        auto result = std::vector<std::string>();
+        std::mutex lock;
+        std::atomic<int> steps(0);
+        std::thread::id poller;
+        bool moved(false);
+        auto record = [&](const std::string& s) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto id = std::this_thread::get_id();
+            if (steps == 0) {
+                poller = id;
+            }
+            moved = moved || id != poller;
+            result.push_back(s);
+            ++steps;
+        };
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_on_entry([&record]() {
+            record("s1");
+        }).with_transition("s1_2_s2", s2, obs1);
+        s2.with_on_entry([&record]() {
+            record("s2");
+        }).with_transition("s2_2_s1", s1, cn, std::chrono::milliseconds(10));
+        sm.with_state(initial, s1, s2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            auto wait = [&steps](int n) {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                while (steps.load() < n && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::yield();
+                }
+            };
+            wait(1);
+            o1.on_next("a");
+            wait(3);
+            std::lock_guard<std::mutex> guard(lock);
+            REQUIRE(result.size() == 3);
+            CHECK(result[0] == "s1");
+            CHECK(result[1] == "s2");
+            CHECK(result[2] == "s1");
+            CHECK(!moved);
+            CHECK(poller != std::this_thread::get_id());
+            auto stats = cn.stats();
+            CHECK(stats.executed > 0);
+            CHECK(stats.working.count() > 0);
+            sm.terminate();
+        }
+    }
+}
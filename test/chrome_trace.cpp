@@ -0,0 +1,66 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "chrome trace", "[fsm][tracer][chrome_trace]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("a traced state machine"){
+        auto out = std::make_shared<std::ostringstream>();
+        auto trace = fsm::make_chrome_trace(out);
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, sm.on_event("GO"), [](const fsm::event_id&) {});
+        s2.with_transition("s2_2_s1", s1, sm.on_event("GO"), [](const fsm::event_id&) {});
+        sm.with_state(initial, s1, s2);
+        sm.with_tracer(trace.get_tracer());
+        WHEN("closed after a number of steps"){
+            CHECK_NOTHROW(sm.start(cn));
+            for(int i = 0; i < 4; ++i)
+            {
+                CHECK(sm.fire("GO"));
+            }
+            trace.close();
+            auto json = out->str();
+            CHECK(json.find("\"traceEvents\":[") != std::string::npos);
+            CHECK(json.substr(json.size() - 4) == "\n]}\n");
+            CHECK(trace.dropped() == 0);
+#if defined(RXCPP_FSM_TRACING)
+            CHECK(json.find("\"thread_name\"") != std::string::npos);
+            CHECK(json.find("\"name\":\"s1/s1_2_s2\"") != std::string::npos);
+            CHECK(json.find("\"cat\":\"state\",\"name\":\"s1\"") != std::string::npos);
+#endif
+        }
+    }
+    GIVEN("a sampled state machine with a small buffer"){
+        auto out = std::make_shared<std::ostringstream>();
+        auto trace = fsm::make_chrome_trace(out, 2, 4);
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("internal", sm.on_event("GO"), [](const fsm::event_id&) {});
+        sm.with_state(initial, s1);
+        sm.with_tracer(trace.get_tracer());
+        WHEN("more steps than fit the buffer"){
+            CHECK_NOTHROW(sm.start(cn));
+            for(int i = 0; i < 100; ++i)
+            {
+                CHECK(sm.fire("GO"));
+            }
+            trace.close();
+            auto json = out->str();
+            std::size_t actions(0);
+            for(auto pos = json.find("\"name\":\"action\""); pos != std::string::npos; pos = json.find("\"name\":\"action\"", pos + 1))
+            {
+                ++actions;
+            }
+#if defined(RXCPP_FSM_TRACING)
+            // every other internal transition is traced, unless dropped since the buffer was full
+            CHECK(actions <= 50);
+            CHECK(actions + trace.dropped() >= 50);
+#else
+            CHECK(actions == 0);
+            CHECK(trace.dropped() == 0);
+#endif
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "event", "[fsm][event]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("event ids"){
+        WHEN("interned"){
+            fsm::event_id connect("CONNECT");
+            CHECK(connect == fsm::event_id(std::string("CONNECT")));
+            CHECK(connect != fsm::event_id("DISCONNECT"));
+            CHECK(connect.is_interned());
+            CHECK(connect.name() == "CONNECT");
+        }
+        WHEN("integer"){
+            fsm::event_id id(42);
+            CHECK(id == fsm::event_id(42));
+            CHECK(!id.is_interned());
+            CHECK(id.name() == "42");
+            CHECK_THROWS(fsm::event_id(std::uint64_t(1) << 63));
+        }
+    }
+    GIVEN("fired events"){
+        auto result = std::vector<std::string>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, sm.on_event<std::string>("CONNECT"), [&result](const std::string& s) {
+            result.push_back("connect " + s);
+        });
+        s2.with_transition("s2_2_s1", s1, sm.on_event(fsm::event_id(7)), [&result](const fsm::event_id& id) {
+            result.push_back("disconnect " + id.name());
+        });
+        s2.with_transition("s2_internal", sm.on_event<std::string>("DATA"), [&result](const std::string& s) {
+            result.push_back("data " + s);
+        }, [](const std::string& s) {
+            return !s.empty();
+        });
+        sm.with_state(initial, s1, s2);
+        WHEN("not assembled"){
+            CHECK_THROWS(sm.fire("CONNECT", std::string("a")));
+            CHECK_THROWS(sm.event_stats());
+        }
+        WHEN("declared with another payload type"){
+            CHECK_THROWS(sm.on_event<int>("CONNECT"));
+        }
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            auto stats = sm.event_stats();
+            CHECK(stats.events == 3);
+            CHECK(stats.buckets > 0);
+            CHECK(stats.bytes > 0);
+            CHECK(sm.fire("CONNECT", std::string("a")));
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "connect a");
+            result.clear();
+            CHECK(sm.fire("DATA", std::string("")));
+            CHECK(sm.fire("DATA", std::string("b")));
+            CHECK(sm.fire("CONNECT", std::string("c")));
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "data b");
+            result.clear();
+            CHECK(sm.fire("DATA", "literal"));
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "data literal");
+            result.clear();
+            CHECK(sm.fire(fsm::event_id(7)));
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "disconnect 7");
+            CHECK(!sm.fire("UNKNOWN"));
+            CHECK_THROWS(sm.fire("CONNECT", 1));
+        }
+    }
+    GIVEN("broadcast dispatcher"){
+        auto result = std::vector<std::string>();
+        auto dispatcher = fsm::make_broadcast_dispatcher();
+        auto sm2 = fsm::make_state_machine("sm2");
+        auto make = [&result](fsm::state_machine& m) {
+            auto initial = fsm::make_initial_pseudostate("initial");
+            auto idle = fsm::make_state("idle");
+            auto listening = fsm::make_state("listening");
+            auto name = m.name();
+            initial.with_transition("initial_2_idle", idle);
+            idle.with_transition("idle_2_listening", listening, m.on_event("LISTEN"));
+            listening.with_transition("listening_2_idle", idle, m.on_event("STOP"));
+            listening.with_transition("tick", m.on_event<int>("TICK"), [&result, name](int i) {
+                result.push_back(name + " tick " + std::to_string(i));
+            });
+            m.with_state(initial, idle, listening);
+        };
+        make(sm);
+        make(sm2);
+        sm.with_broadcast_dispatcher(dispatcher);
+        sm2.with_broadcast_dispatcher(dispatcher);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK_NOTHROW(sm2.start(cn));
+            CHECK(dispatcher.interested("TICK") == 0);
+            CHECK(dispatcher.interested("LISTEN") == 2);
+            CHECK(dispatcher.fire("TICK", 1) == 0);
+            CHECK(result.empty());
+            CHECK(sm2.fire("LISTEN"));
+            CHECK(dispatcher.interested("TICK") == 1);
+            CHECK(dispatcher.interested("LISTEN") == 1);
+            CHECK(dispatcher.fire("TICK", 2) == 1);
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "sm2 tick 2");
+            CHECK(dispatcher.fire("LISTEN") == 1);
+            CHECK(dispatcher.interested("TICK") == 2);
+            CHECK(dispatcher.fire("STOP") == 2);
+            CHECK(dispatcher.interested("TICK") == 0);
+            CHECK(dispatcher.interested("LISTEN") == 2);
+            sm2.terminate();
+        }
+    }
+    GIVEN("broadcast dispatcher of a state machine with a sub machine"){
+        auto result = std::vector<std::string>();
+        auto dispatcher = fsm::make_broadcast_dispatcher();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        initial.with_transition("initial_2_s1", s1);
+        sm.with_state(initial, s1);
+        auto sub_machine = fsm::make_state_machine("sub_machine");
+        auto sub_initial = fsm::make_initial_pseudostate("sub_initial");
+        auto idle = fsm::make_state("idle");
+        auto pinged = fsm::make_state("pinged");
+        sub_initial.with_transition("sub_initial_2_idle", idle);
+        idle.with_transition("idle_2_pinged", pinged, sub_machine.on_event("PING"));
+        pinged.with_on_entry([&result]() {result.push_back("pinged");});
+        sub_machine.with_state(sub_initial, idle, pinged);
+        s1.with_state_machine(sub_machine);
+        sm.with_broadcast_dispatcher(dispatcher);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK(dispatcher.interested("PING") == 1);
+            CHECK(dispatcher.fire("PING") == 1);
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "pinged");
+            CHECK(dispatcher.interested("PING") == 0);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "event source", "[fsm][event_source]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("an event source"){
+        fsm::event_source<int> source;
+        WHEN("subscribed and unsubscribed"){
+            auto result = std::vector<int>();
+            CHECK(source.subscriber_count() == 0);
+            auto s1 = source.get_observable().subscribe([&result](int i) { result.push_back(i); });
+            auto s2 = source.get_observable().subscribe([&result](int i) { result.push_back(-i); });
+            CHECK(source.subscriber_count() == 2);
+            source.on_next(1);
+            REQUIRE(result.size() == 2);
+            CHECK(result[0] == 1);
+            CHECK(result[1] == -1);
+            s1.unsubscribe();
+            CHECK(source.subscriber_count() == 1);
+            s1.unsubscribe();
+            CHECK(source.subscriber_count() == 1);
+            result.clear();
+            source.on_next(2);
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == -2);
+            s2.unsubscribe();
+            CHECK(source.subscriber_count() == 0);
+            source.on_next(3);
+            CHECK(result.size() == 1);
+        }
+        WHEN("unsubscribed from on_next"){
+            auto result = std::vector<int>();
+            rxcpp::composite_subscription lifetime;
+            source.get_observable().subscribe(lifetime, [&result, &lifetime](int i) {
+                result.push_back(i);
+                lifetime.unsubscribe();
+            });
+            source.on_next(1);
+            source.on_next(2);
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == 1);
+            CHECK(source.subscriber_count() == 0);
+        }
+        WHEN("many subscribers"){
+            std::size_t n(0);
+            std::vector<rxcpp::composite_subscription> subscriptions;
+            for(int i = 0; i < 1000; ++i)
+            {
+                subscriptions.push_back(source.get_observable().subscribe([&n](int) { ++n; }));
+            }
+            source.on_next(1);
+            CHECK(n == 1000);
+            for(std::size_t i = 0; i < subscriptions.size(); i += 2)
+            {
+                subscriptions[i].unsubscribe();
+            }
+            CHECK(source.subscriber_count() == 500);
+            source.on_next(1);
+            CHECK(n == 1500);
+            for(int i = 0; i < 500; ++i)
+            {
+                subscriptions.push_back(source.get_observable().subscribe([&n](int) { ++n; }));
+            }
+            source.on_next(1);
+            CHECK(n == 2500);
+        }
+    }
+    GIVEN("a state machine triggered by an event source"){
+        fsm::event_source<int> source;
+        auto result = std::vector<std::string>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, source.get_observable(), [&result](int i) {
+            result.push_back("s1_2_s2 " + std::to_string(i));
+        });
+        s2.with_transition("s2_2_s1", s1, source.get_observable(), [&result](int i) {
+            result.push_back("s2_2_s1 " + std::to_string(i));
+        });
+        sm.with_state(initial, s1, s2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK(source.subscriber_count() == 1);
+            source.on_next(1);
+            source.on_next(2);
+            source.on_next(3);
+            REQUIRE(result.size() == 3);
+            CHECK(result[0] == "s1_2_s2 1");
+            CHECK(result[1] == "s2_2_s1 2");
+            CHECK(result[2] == "s1_2_s2 3");
+            CHECK(source.subscriber_count() == 1);
+            sm.terminate();
+            CHECK(source.subscriber_count() == 0);
+        }
+    }
+}
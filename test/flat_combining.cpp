@@ -0,0 +1,129 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "flat combining", "[fsm][flat_combining]"){
+    auto cn = fsm::make_flat_combining();
+    GIVEN("a state machine fed by many threads"){
+        rxcpp::subjects::subject<int> subject;
+        auto subscriber = subject.get_subscriber();
+        auto trigger = subject.get_observable();
+        std::atomic<int> inside(0);
+        std::atomic<bool> overlapped(false);
+        int transitions(0), entries(0);
+        auto action = [&inside, &overlapped, &transitions](int) {
+            if (inside.fetch_add(1) != 0) {
+                overlapped = true;
+            }
+            ++transitions;
+            inside.fetch_sub(1);
+        };
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, trigger, action);
+        s2.with_transition("s2_2_s1", s1, trigger, action);
+        s1.with_on_entry([&entries]() {
+            ++entries;
+        });
+        sm.with_state(initial, s1, s2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK(entries == 1);
+            std::vector<std::thread> producers;
+            for(int t = 0; t < 4; ++t)
+            {
+                producers.emplace_back([&subscriber]() {
+                    for(int i = 0; i < 1000; ++i)
+                    {
+                        subscriber.on_next(i);
+                    }
+                });
+            }
+            for(auto& p : producers)
+            {
+                p.join();
+            }
+            // events delivered to the trigger of a state that is exited before they are processed are dropped
+            CHECK(!overlapped);
+            CHECK(transitions > 0);
+            CHECK(transitions <= 4000);
+            CHECK(entries == 1 + transitions / 2);
+            sm.terminate();
+        }
+    }
+    GIVEN("an entry action firing into the same state machine"){
+        rxcpp::subjects::subject<int> subject;
+        auto subscriber = subject.get_subscriber();
+        auto result = std::vector<std::string>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, subject.get_observable(), [&result](int i) {
+            result.push_back("s1_2_s2 " + std::to_string(i));
+        });
+        s2.with_on_entry([&result, &subscriber]() {
+            subscriber.on_next(2);
+            result.push_back("s2 entered");
+        }).with_transition("s2_2_s1", s1, subject.get_observable(), [&result](int i) {
+            result.push_back("s2_2_s1 " + std::to_string(i));
+        });
+        sm.with_state(initial, s1, s2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            subscriber.on_next(1);
+            // the event fired by the entry action is processed after the current run-to-completion step
+            REQUIRE(result.size() == 3);
+            CHECK(result[0] == "s1_2_s2 1");
+            CHECK(result[1] == "s2 entered");
+            CHECK(result[2] == "s2_2_s1 2");
+            sm.terminate();
+        }
+    }
+    GIVEN("two state machines triggering each other and themselves"){
+        auto cn2 = fsm::make_flat_combining();
+        auto sm2 = fsm::make_state_machine("sm2");
+        rxcpp::subjects::subject<int> a, b;
+        auto a_subscriber = a.get_subscriber();
+        auto b_subscriber = b.get_subscriber();
+        auto result = std::vector<std::string>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        auto s3 = fsm::make_state("s3");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, a.get_observable(), [&b_subscriber](int) {
+            // combined inline, nested in the combine of sm
+            b_subscriber.on_next(1);
+        });
+        s2.with_on_entry([&result, &a_subscriber]() {
+            result.push_back("s2 entered");
+            a_subscriber.on_next(3);
+        }).with_transition("s2_2_s3", s3, a.get_observable(), [&result](int i) {
+            result.push_back("s2_2_s3 " + std::to_string(i));
+        });
+        sm.with_state(initial, s1, s2, s3);
+        auto initial2 = fsm::make_initial_pseudostate("initial");
+        auto t1 = fsm::make_state("t1");
+        auto t2 = fsm::make_state("t2");
+        initial2.with_transition("initial_2_t1", t1);
+        t1.with_transition("t1_2_t2", t2, b.get_observable());
+        t2.with_on_entry([&result, &a_subscriber]() {
+            result.push_back("t2 entered");
+            a_subscriber.on_next(2);
+        });
+        sm2.with_state(initial2, t1, t2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK_NOTHROW(sm2.start(cn2));
+            a_subscriber.on_next(1);
+            // the events fired into sm while combining it are processed after its current step
+            REQUIRE(result.size() == 3);
+            CHECK(result[0] == "t2 entered");
+            CHECK(result[1] == "s2 entered");
+            CHECK(result[2] == "s2_2_s3 2");
+            sm2.terminate();
+            sm.terminate();
+        }
+    }
+}
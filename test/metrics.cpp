@@ -0,0 +1,60 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "metrics", "[fsm][tracer][metrics]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("a state machine with guarded transitions"){
+        auto allowed = true;
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        auto s2_initial = fsm::make_initial_pseudostate("s2_initial");
+        auto s21 = fsm::make_state("s21");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, sm.on_event("GO"), [&allowed](const fsm::event_id&) {return allowed;});
+        s2_initial.with_transition("s2_initial_2_s21", s21);
+        s2.with_sub_state(s2_initial, s21)
+          .with_transition("s2_2_s1", s1, sm.on_event("BACK"));
+        sm.with_state(initial, s1, s2);
+        CHECK_THROWS(sm.metrics());
+#if defined(RXCPP_FSM_TRACING)
+        sm.with_metrics();
+        WHEN("started and events are fired"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK_THROWS(sm.with_metrics());
+            allowed = false;
+            CHECK(sm.fire("GO"));
+            allowed = true;
+            CHECK(sm.fire("GO"));
+            CHECK(sm.fire("BACK"));
+            CHECK(sm.fire("BACK"));
+            CHECK_FALSE(sm.fire("UNKNOWN"));
+            auto m = sm.metrics();
+            CHECK(m.name == "sm");
+            REQUIRE(m.find_state("s1"));
+            REQUIRE(m.find_state("s2/s21"));
+            REQUIRE(m.find_transition("s1/s1_2_s2"));
+            REQUIRE(m.find_transition("s2/s21") == nullptr);
+            auto s1m = m.find_state("s1");
+            CHECK(s1m->entered == 2);
+            CHECK(s1m->exited == 1);
+            CHECK(s1m->unhandled == 1);
+            CHECK(s1m->dwell.count() == 1);
+            CHECK(m.find_state("s2/s21")->entered == 1);
+            auto t = m.find_transition("s1/s1_2_s2");
+            CHECK(t->fired == 1);
+            CHECK(t->guard_passed == 1);
+            CHECK(t->guard_failed == 1);
+            CHECK(t->guard.count() == 2);
+            CHECK(t->action.count() == 1);
+            // BACK while in s1, and UNKNOWN
+            CHECK(m.ignored == 2);
+        }
+#else
+        WHEN("metrics are enabled"){
+            // the trace points collecting them are compiled out
+            CHECK_THROWS_AS(sm.with_metrics(), fsm::not_allowed);
+            CHECK_THROWS(sm.metrics());
+        }
+#endif
+    }
+}
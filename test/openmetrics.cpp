@@ -0,0 +1,51 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "openmetrics", "[fsm][tracer][metrics][openmetrics]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("a state machine with a timeout transition"){
+        auto vt = fsm::make_virtual_time();
+        auto exporter = fsm::make_openmetrics_exporter(1);
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, sm.on_event("GO"))
+          .with_transition("s1_timeout", s2, std::chrono::hours(1));
+        s2.with_transition("s2_2_s1", s1, sm.on_event("BACK"));
+        sm.with_state(initial, s1, s2);
+        sm.with_virtual_time(vt);
+#if defined(RXCPP_FSM_TRACING)
+        exporter.with_state_machine(sm);
+#else
+        // the trace points collecting the metrics are compiled out
+        CHECK_THROWS_AS(exporter.with_state_machine(sm), fsm::not_allowed);
+#endif
+        WHEN("the timeout is cancelled once and fires once"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK(sm.fire("GO"));
+            CHECK(sm.fire("BACK"));
+            vt.advance_by(std::chrono::hours(1));
+            auto text = exporter.to_string();
+            CHECK(text.find("# TYPE rxcpp_fsm_transitions counter\n") != std::string::npos);
+            CHECK(text.find("# TYPE rxcpp_fsm_state_dwell_seconds histogram\n# UNIT rxcpp_fsm_state_dwell_seconds seconds\n") != std::string::npos);
+            CHECK(text.substr(text.size() - 6) == "# EOF\n");
+            std::string appended("prefix\n");
+            exporter.write(appended);
+            CHECK(appended.substr(0, 7) == "prefix\n");
+            CHECK(appended.substr(appended.size() - 6) == "# EOF\n");
+#if defined(RXCPP_FSM_TRACING)
+            CHECK(text.find("rxcpp_fsm_instances{definition=\"sm\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_transitions_total{definition=\"sm\",transition=\"s1/s1_2_s2\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_timeout_fires_total{definition=\"sm\",transition=\"s1/s1_timeout\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_timeout_cancels_total{definition=\"sm\",transition=\"s1/s1_timeout\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_active_states{definition=\"sm\",state=\"s1\"} 0\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_active_states{definition=\"sm\",state=\"s2\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_state_dwell_seconds_count{definition=\"sm\",state=\"s1\"} 2\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_state_dwell_seconds_bucket{definition=\"sm\",state=\"s1\",le=\"+Inf\"} 2\n") != std::string::npos);
+            // BACK of the active state s2
+            CHECK(text.find("rxcpp_fsm_live_subscriptions{definition=\"sm\"} 1\n") != std::string::npos);
+            CHECK(text.find("rxcpp_fsm_instance_active_states{definition=\"sm\",instance=\"0\"} 1\n") != std::string::npos);
+#endif
+        }
+    }
+}
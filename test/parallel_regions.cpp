@@ -0,0 +1,81 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "parallel regions", "[fsm][region][parallel_regions]"){
+    auto cn = rxcpp::identity_immediate();
+    FSM_SUBJECT(1);
+    GIVEN("an orthogonal state with three regions"){
+        // every region waits for the others, i.e. the actions only complete if they run concurrently
+        auto barrier = [](std::atomic<int>& arrived) {
+            arrived.fetch_add(1);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (arrived.load() < 3 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            return arrived.load() >= 3;
+        };
+        std::atomic<int> entered(0), exited(0);
+        std::atomic<bool> entered_together(true), exited_together(true);
+        std::vector<std::string> result;
+        std::vector<std::vector<std::string>> region_result(3);
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1").with_on_entry([&result]() {result.push_back("s1");});
+        auto s2 = fsm::make_state("s2").with_on_entry([&result]() {result.push_back("s2");});
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, obs1);
+        std::vector<fsm::region> regions;
+        for(std::size_t i = 0; i < 3; ++i)
+        {
+            auto name = std::to_string(i + 1);
+            auto& r_result = region_result[i];
+            auto r = fsm::make_region("r" + name);
+            auto r_initial = fsm::make_initial_pseudostate("s" + name + "_initial");
+            auto r_s1 = fsm::make_state("s" + name + "_1");
+            r_s1.with_on_entry([&r_result, &entered, &entered_together, barrier, name]() {
+                r_result.push_back("s" + name + "_1");
+                if (!barrier(entered)) {
+                    entered_together = false;
+                }
+            });
+            r_s1.with_on_exit([&r_result, &exited, &exited_together, barrier, name]() {
+                r_result.push_back("xs" + name + "_1");
+                if (!barrier(exited)) {
+                    exited_together = false;
+                }
+            });
+            r_initial.with_transition("s" + name + "_initial_2_s" + name + "_1", r_s1, [&r_result, name]() {
+                r_result.push_back("s" + name + "_initial_2_s" + name + "_1");
+            });
+            r.with_sub_state(r_initial, r_s1);
+            regions.push_back(r);
+        }
+        s1.with_region(regions[0], regions[1], regions[2]);
+        sm.with_state(initial, s1, s2);
+        sm.with_parallel_regions(rxcpp::schedulers::make_new_thread());
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK(entered == 3);
+            CHECK(entered_together);
+            REQUIRE(result.size() == 1);
+            CHECK(result[0] == "s1");
+            for(std::size_t i = 0; i < 3; ++i)
+            {
+                auto name = std::to_string(i + 1);
+                REQUIRE(region_result[i].size() == 2);
+                CHECK(region_result[i][0] == "s" + name + "_initial_2_s" + name + "_1");
+                CHECK(region_result[i][1] == "s" + name + "_1");
+            }
+            o1.on_next("leave");
+            CHECK(exited == 3);
+            CHECK(exited_together);
+            REQUIRE(result.size() == 2);
+            CHECK(result[1] == "s2");
+            for(std::size_t i = 0; i < 3; ++i)
+            {
+                REQUIRE(region_result[i].size() == 3);
+                CHECK(region_result[i][2] == "xs" + std::to_string(i + 1) + "_1");
+            }
+            CHECK_THROWS(sm.with_parallel_regions(rxcpp::schedulers::make_new_thread()));
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "node pool", "[fsm][pool]"){
+    auto cn = rxcpp::identity_immediate();
+    FSM_SUBJECT(1);
+    GIVEN("a state machine cycling between composite states"){
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1_initial = fsm::make_initial_pseudostate("s1_initial");
+        auto s1_1 = fsm::make_state("s1_1");
+        auto s1 = fsm::make_state("s1").with_sub_state(s1_initial, s1_1);
+        auto s2_initial = fsm::make_initial_pseudostate("s2_initial");
+        auto s2_1 = fsm::make_state("s2_1");
+        auto s2 = fsm::make_state("s2").with_sub_state(s2_initial, s2_1);
+        initial.with_transition("initial_2_s1", s1);
+        s1_initial.with_transition("s1_initial_2_s1_1", s1_1);
+        s2_initial.with_transition("s2_initial_2_s2_1", s2_1);
+        s1.with_transition("s1_2_s2", s2, obs1);
+        s2.with_transition("s2_2_s1", s1, obs1);
+        sm.with_state(initial, s1, s2);
+        WHEN("start"){
+            CHECK_NOTHROW(sm.start(cn));
+            auto started = sm.pool_stats();
+            CHECK(started.in_use > 0);
+            CHECK(started.allocated >= started.in_use);
+            o1.on_next("a");
+            auto cycled = sm.pool_stats();
+            for(int i = 0; i < 1000; ++i)
+            {
+                o1.on_next("a");
+            }
+            auto stats = sm.pool_stats();
+            CHECK(stats.in_use == cycled.in_use);
+            CHECK(stats.allocated == cycled.allocated);
+            CHECK(stats.high_water_mark == cycled.high_water_mark);
+        }
+    }
+}
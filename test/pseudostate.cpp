@@ -596,3 +596,51 @@ SCENARIO_METHOD(fsm::string_fixture3, "pseudostate", "[fsm][pseudostate]"){
         }
     }
 }
+
+SCENARIO_METHOD(fsm::string_fixture3, "deep history of orthogonal state", "[fsm][pseudostate]"){
+    auto cn = rxcpp::identity_immediate();
+    FSM_SUBJECT(1);
+    FSM_SUBJECT(2);
+    FSM_SUBJECT(3);
+    GIVEN("more active states than stored inline"){
+        std::vector<std::string> result;
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s0_initial = fsm::make_initial_pseudostate("s0_initial");
+        auto s0_history = fsm::make_deep_history_pseudostate("s0_history");
+        auto s1 = fsm::make_state("s1");
+        auto s0 = fsm::make_state("s0").with_sub_state(s0_initial, s1, s0_history);
+        auto s2 = fsm::make_state("s2");
+        sm.with_state(initial, s0, s2);
+        initial.with_transition("initial_2_s0", s0);
+        s0_initial.with_transition("s0_initial_2_s1", s1);
+        s0.with_transition("s0_2_s2", s2, obs2);
+        s2.with_transition("s2_2_s0_history", s0_history, obs3);
+        const int regions = 6;
+        for(int i = 0; i < regions; ++i)
+        {
+            auto name = std::to_string(i + 1);
+            auto r = fsm::make_region("r" + name);
+            auto r_initial = fsm::make_initial_pseudostate("s1" + name + "_initial");
+            auto r_1 = fsm::make_state("s1" + name + "_1");
+            auto r_2 = fsm::make_state("s1" + name + "_2").with_on_entry([&result, name]() {result.push_back("s1" + name + "_2");});
+            r_initial.with_transition("s1" + name + "_initial_2_s1" + name + "_1", r_1);
+            r_1.with_transition("s1" + name + "_1_2_s1" + name + "_2", r_2, obs1);
+            r.with_sub_state(r_initial, r_1, r_2);
+            s1.with_region(r);
+        }
+        WHEN("history is restored"){
+            CHECK_NOTHROW(sm.start(cn));
+            o1.on_next("a");
+            REQUIRE(result.size() == regions);
+            result.clear();
+            o2.on_next("a");
+            CHECK(result.empty());
+            o3.on_next("a");
+            REQUIRE(result.size() == regions);
+            for(int i = 0; i < regions; ++i)
+            {
+                CHECK(result[i] == "s1" + std::to_string(i + 1) + "_2");
+            }
+        }
+    }
+}
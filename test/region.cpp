@@ -494,3 +494,74 @@ SCENARIO_METHOD(fsm::string_fixture6, "region 1", "[fsm][state][region]"){
         }
     }
 }
+
+SCENARIO_METHOD(fsm::string_fixture4, "wide region", "[fsm][state][region]"){
+    auto cn = rxcpp::identity_immediate();
+    auto initial = fsm::make_initial_pseudostate("initial");
+    FSM_SUBJECT(1);
+    FSM_SUBJECT(2);
+    FSM_SUBJECT(3);
+    FSM_SUBJECT(4);
+    std::vector<std::string> result;
+    auto s1 = fsm::make_state("s1");
+    auto s2 = fsm::make_state("s2").with_on_entry([&result]() {result.push_back("s2");});
+    auto join = fsm::make_join_pseudostate("join");
+    sm.with_state(initial, s1, s2, join);
+    initial.with_transition("initial_2_s1", s1);
+    s1.with_transition("s1_2_s2", s2, [&result](){result.push_back("s1_2_s2");});
+    join.with_transition("join_2_s2", s2);
+    const int regions = 64;
+    for(int i = 0; i < regions; ++i)
+    {
+        auto name = std::to_string(i + 1);
+        auto r = fsm::make_region("r" + name);
+        auto r_initial = fsm::make_initial_pseudostate("s" + name + "_initial");
+        auto r_s1 = fsm::make_state("s" + name + "_1");
+        auto r_final = fsm::make_final_state("s" + name + "_final");
+        r_initial.with_transition("s" + name + "_initial_2_s" + name + "_1", r_s1);
+        // the first region completes on triggers of its own
+        r_s1.with_transition("s" + name + "_1_2_s" + name + "_final", r_final, i == 0 ? obs3 : obs1);
+        r_s1.with_transition("s" + name + "_1_2_join", join, i == 0 ? obs4 : obs2);
+        r.with_sub_state(r_initial, r_s1, r_final);
+        s1.with_region(r);
+    }
+    auto o = sm.assemble(cn);
+    o.subscribe([](const fsm::transition&){}, [&result](std::exception_ptr eptr) {
+        try {
+            std::rethrow_exception(eptr);
+        } catch(const fsm::join_error&) {
+            result.push_back("join_error");
+        }
+    });
+    WHEN("all regions are finalized"){
+        o3.on_next("a");
+        CHECK(result.size() == 0);
+        o1.on_next("a");
+        REQUIRE(result.size() == 2);
+        CHECK(result[0] == "s1_2_s2");
+        CHECK(result[1] == "s2");
+    }
+    WHEN("all regions are joined"){
+        o4.on_next("a");
+        CHECK(result.size() == 0);
+        o2.on_next("a");
+        REQUIRE(result.size() == 1);
+        CHECK(result[0] == "s2");
+    }
+    WHEN("one region is finalized and the others are joined"){
+        o3.on_next("a");
+        CHECK(result.size() == 0);
+        o2.on_next("a");
+        REQUIRE(result.size() >= 1);
+        CHECK(result[0] == "join_error");
+        CHECK(std::find(result.begin(), result.end(), "s2") == result.end());
+    }
+    WHEN("one region is joined and the others are finalized"){
+        o4.on_next("a");
+        CHECK(result.size() == 0);
+        o1.on_next("a");
+        REQUIRE(result.size() >= 1);
+        CHECK(result[0] == "join_error");
+        CHECK(std::find(result.begin(), result.end(), "s2") == result.end());
+    }
+}
@@ -0,0 +1,78 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "sharded runtime", "[fsm][sharded_runtime]"){
+    auto runtime = fsm::make_sharded_runtime(2, false);
+    GIVEN("shards"){
+        WHEN("hashed"){
+            CHECK(runtime.size() == 2);
+            CHECK(runtime.shard_for("sm").index() == runtime.shard_for("sm").index());
+            CHECK(runtime.shard_for(std::uint64_t(42)).index() < 2);
+            CHECK(runtime.get_shard(1).index() == 1);
+            CHECK_THROWS(runtime.get_shard(2));
+        }
+    }
+    GIVEN("two state machines on different shards, posting to each other"){
+        const int rounds = 1000;
+        auto sm2 = fsm::make_state_machine("sm2");
+        rxcpp::subjects::subject<int> ping, pong;
+        std::atomic<int> pings(0), pongs(0);
+        std::atomic<int> started(0);
+        std::thread::id thread1, thread2;
+        bool moved1(false), moved2(false);
+        auto make = [&started](fsm::state_machine& m, const rxcpp::observable<int>& trigger, std::function<void(int)> action) {
+            auto initial = fsm::make_initial_pseudostate("initial");
+            auto s1 = fsm::make_state("s1");
+            initial.with_transition("initial_2_s1", s1);
+            s1.with_on_entry([&started]() {
+                ++started;
+            }).with_transition("receive", trigger, action);
+            m.with_state(initial, s1);
+        };
+        auto pong_subscriber = pong.get_subscriber();
+        auto ping_subscriber = ping.get_subscriber();
+        make(sm, ping.get_observable(), [&](int i) {
+            auto id = std::this_thread::get_id();
+            if (pings++ == 0) {
+                thread1 = id;
+            }
+            moved1 = moved1 || id != thread1;
+            pong_subscriber.on_next(i);
+        });
+        make(sm2, pong.get_observable(), [&](int i) {
+            auto id = std::this_thread::get_id();
+            if (pongs++ == 0) {
+                thread2 = id;
+            }
+            moved2 = moved2 || id != thread2;
+            if (i < rounds) {
+                ping_subscriber.on_next(i + 1);
+            }
+        });
+        WHEN("started"){
+            sm.start(runtime.get_shard(0));
+            sm2.start(runtime.get_shard(1));
+            while (started.load() < 2)
+            {
+                std::this_thread::yield();
+            }
+            ping_subscriber.on_next(1);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (pongs.load() < rounds && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            CHECK(pings == rounds);
+            CHECK(pongs == rounds);
+            CHECK(!moved1);
+            CHECK(!moved2);
+            CHECK(thread1 != thread2);
+            auto stats0 = runtime.stats(0);
+            auto stats1 = runtime.stats(1);
+            CHECK(stats0.ring_posts > 0);
+            CHECK(stats1.ring_posts > 0);
+            CHECK(stats0.inbox_posts > 0);
+            sm.terminate();
+            sm2.terminate();
+        }
+    }
+}
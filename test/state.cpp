@@ -36,6 +36,19 @@ SCENARIO_METHOD(fsm::string_fixture5, "simple state", "[fsm][state]"){
         auto r1 = fsm::make_region("r1");
         CHECK_THROWS(s1.with_region(r1));
     }
+    GIVEN("state kept after its state machine is destroyed"){
+        auto ks = fsm::make_state("ks");
+        auto initial2 = fsm::make_initial_pseudostate("initial2");
+        {
+            auto sm2 = fsm::make_state_machine("sm2");
+            sm2.with_state(initial2)
+                    .with_state(ks);
+            initial2.with_transition("initial2", ks);
+            REQUIRE_NOTHROW(sm2.start(cn));
+        }
+        auto ks_1 = fsm::make_state("ks_1");
+        CHECK_THROWS(ks.with_sub_state(ks_1));
+    }
     GIVEN("completion transitions"){
         s1.with_on_exit([&result]() {result.push_back("s1_exit");});
         s2.with_on_exit([&result]() {result.push_back("s2_exit");});
@@ -840,6 +853,12 @@ SCENARIO_METHOD(fsm::string_fixture2, "sub machine state", "[fsm][state]"){
         CHECK(s1.is_sub_machine());
         CHECK_THROWS(sub_machine.start(cn));
     }
+    GIVEN("sub machine attached after its states were built"){
+        CHECK_NOTHROW(ss2.with_transition("ss2_2_ss1", ss1, obs2));
+        CHECK_NOTHROW(s1.with_state_machine(sub_machine));
+        REQUIRE_NOTHROW(sm.start(cn));
+        CHECK_THROWS(ss1.with_transition("ss1_2_ss1", ss1, obs2));
+    }
     GIVEN("simple sub machine"){
         CHECK_NOTHROW(s1.with_state_machine(sub_machine));
         REQUIRE_NOTHROW(sm.start(cn));
@@ -0,0 +1,80 @@
+#include "test.h"
+
+namespace {
+
+struct recording_tracer : fsm::tracer
+{
+    std::vector<std::string> vertices;
+    std::vector<std::string> entered;
+    std::vector<std::string> exited;
+    std::size_t actions{0};
+    std::size_t ignored{0};
+
+    void assembled(std::uint32_t, const std::string&, const std::vector<std::string>& v, const std::vector<std::string>&) override
+    {
+        vertices = v;
+    }
+
+    void action_executed(std::uint32_t, std::uint64_t start, std::uint64_t end, std::uint32_t) override
+    {
+        CHECK(start <= end);
+        ++actions;
+    }
+
+    void state_entered(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t state) override
+    {
+        entered.push_back(vertices.at(state));
+    }
+
+    void state_exited(std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t state, std::uint64_t) override
+    {
+        exited.push_back(vertices.at(state));
+    }
+
+    void event_ignored(std::uint32_t, std::uint64_t, std::uint64_t) override
+    {
+        ++ignored;
+    }
+};
+
+}
+
+SCENARIO_METHOD(fsm::string_fixture1, "tracer", "[fsm][tracer]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("a state machine with a composite state"){
+        auto t = std::make_shared<recording_tracer>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        auto s2_initial = fsm::make_initial_pseudostate("s2_initial");
+        auto s21 = fsm::make_state("s21");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_transition("s1_2_s2", s2, sm.on_event("GO"), [](const fsm::event_id&) {});
+        s2_initial.with_transition("s2_initial_2_s21", s21);
+        s2.with_sub_state(s2_initial, s21);
+        sm.with_state(initial, s1, s2);
+        sm.with_tracer(t);
+        WHEN("started and events are fired"){
+            CHECK_NOTHROW(sm.start(cn));
+            CHECK_THROWS(sm.with_tracer(t));
+            CHECK(sm.fire("GO"));
+            CHECK_FALSE(sm.fire("UNKNOWN"));
+#if defined(RXCPP_FSM_TRACING)
+            CHECK(std::find(t->vertices.begin(), t->vertices.end(), "s2/s21") != t->vertices.end());
+            REQUIRE(t->entered.size() == 3);
+            CHECK(t->entered[0] == "s1");
+            CHECK(t->entered[1] == "s2");
+            CHECK(t->entered[2] == "s2/s21");
+            REQUIRE(t->exited.size() == 1);
+            CHECK(t->exited[0] == "s1");
+            CHECK(t->actions >= 1);
+            CHECK(t->ignored == 1);
+#else
+            // the trace points are compiled out
+            CHECK(t->vertices.empty());
+            CHECK(t->entered.empty());
+            CHECK(t->ignored == 0);
+#endif
+        }
+    }
+}
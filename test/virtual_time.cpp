@@ -0,0 +1,44 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "virtual time", "[fsm][virtual_time]"){
+    auto cn = rxcpp::identity_immediate();
+    GIVEN("timeout transitions of hours"){
+        auto vt = fsm::make_virtual_time();
+        auto result = std::vector<std::string>();
+        auto initial = fsm::make_initial_pseudostate("initial");
+        auto s1 = fsm::make_state("s1");
+        auto s2 = fsm::make_state("s2");
+        auto s3 = fsm::make_state("s3");
+        initial.with_transition("initial_2_s1", s1);
+        s1.with_on_entry([&result]() {result.push_back("s1");})
+          .with_transition("s1_2_s2", s2, std::chrono::hours(1));
+        s2.with_on_entry([&result]() {result.push_back("s2");})
+          .with_transition("s2_2_s3", s3, rxcpp::observe_on_new_thread(), std::chrono::hours(24));
+        s3.with_on_entry([&result]() {result.push_back("s3");})
+          .with_transition("s3_2_s1", s1, std::chrono::milliseconds(1));
+        sm.with_state(initial, s1, s2, s3);
+        sm.with_virtual_time(vt);
+        WHEN("advanced"){
+            CHECK_NOTHROW(sm.start(cn));
+            REQUIRE(result.size() == 1);
+            vt.advance_by(std::chrono::minutes(59));
+            CHECK(result.size() == 1);
+            vt.advance_by(std::chrono::minutes(1));
+            REQUIRE(result.size() == 2);
+            CHECK(result[1] == "s2");
+            vt.advance_by(std::chrono::hours(23));
+            CHECK(result.size() == 2);
+            vt.advance_to(vt.now() + std::chrono::hours(1));
+            REQUIRE(result.size() == 3);
+            CHECK(result[2] == "s3");
+            vt.advance_by(std::chrono::milliseconds(1));
+            REQUIRE(result.size() == 4);
+            CHECK(result[3] == "s1");
+            // ten more days, i.e. another 9 full cycles of 25 hours and 1 millisecond
+            vt.advance_by(std::chrono::hours(240));
+            CHECK(result.size() == 4 + 9 * 3 + 1);
+            CHECK(result.back() == "s2");
+            CHECK_THROWS(sm.with_virtual_time(fsm::make_virtual_time()));
+        }
+    }
+}
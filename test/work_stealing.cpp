@@ -0,0 +1,92 @@
+#include "test.h"
+
+SCENARIO_METHOD(fsm::string_fixture1, "work stealing", "[fsm][work_stealing]"){
+    GIVEN("many state machines on one work stealing scheduler"){
+        auto ws = fsm::make_work_stealing(4);
+        const int machines = 200;
+        const int events = 50;
+        struct machine
+        {
+            fsm::state_machine sm;
+            rxcpp::subjects::subject<int> subject;
+            std::atomic<int> inside;
+            std::atomic<int> transitions;
+            std::atomic<bool> overlapped;
+            std::atomic<bool> started;
+
+            machine(const std::string& name)
+                : sm(fsm::make_state_machine(name))
+                , inside(0)
+                , transitions(0)
+                , overlapped(false)
+                , started(false)
+            {
+            }
+        };
+        std::vector<std::unique_ptr<machine>> ms;
+        for(int i = 0; i < machines; ++i)
+        {
+            ms.emplace_back(new machine("sm" + std::to_string(i)));
+            auto m = ms.back().get();
+            auto action = [m](int) {
+                if (m->inside.fetch_add(1) != 0) {
+                    m->overlapped = true;
+                }
+                ++m->transitions;
+                m->inside.fetch_sub(1);
+            };
+            auto initial = fsm::make_initial_pseudostate("initial");
+            auto s1 = fsm::make_state("s1");
+            initial.with_transition("initial_2_s1", s1);
+            s1.with_on_entry([m]() {
+                m->started = true;
+            }).with_transition("count", m->subject.get_observable(), action);
+            m->sm.with_state(initial, s1);
+        }
+        WHEN("started and fed"){
+            for(auto& m : ms)
+            {
+                m->sm.start(ws.create_coordination());
+            }
+            for(auto& m : ms)
+            {
+                while (!m->started)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            for(int e = 0; e < events; ++e)
+            {
+                for(auto& m : ms)
+                {
+                    m->subject.get_subscriber().on_next(e);
+                }
+            }
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            for(auto& m : ms)
+            {
+                while (m->transitions.load() < events && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            bool overlapped(false);
+            int transitions(0);
+            for(auto& m : ms)
+            {
+                overlapped = overlapped || m->overlapped;
+                transitions += m->transitions;
+            }
+            CHECK(!overlapped);
+            CHECK(transitions == machines * events);
+            auto stats = ws.stats();
+            CHECK(stats.threads == 4);
+            CHECK(stats.strands >= static_cast<std::size_t>(machines));
+            CHECK(stats.runs > 0);
+            for(auto& m : ms)
+            {
+                m->sm.terminate();
+            }
+        }
+    }
+}